@@ -0,0 +1,220 @@
+// OBJ 加载基准测试
+// 对比原先 std::getline + std::istringstream 逐行解析的加载器、内存映射 + from_chars 的 objl::Loader（不读写缓存）
+// 以及直接映射二进制网格缓存（.meshcache）的加载，对目录下的每个 .obj 文件分别测量加载吞吐量（MB/s，按 OBJ 文件字节数计算）；
+// 最后对其中最大的文件用不同的线程数解析，观察并行分块解析的加速比
+// 用法：obj_loader_bench [模型目录或文件] [每个文件的最短计时毫秒数]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include "OBJ_Loader.h"
+
+// 原先 objl::Loader::Load 的实现：逐行读入并构造 istringstream，数组不预先分配
+static bool legacy_load(const std::string &path, MeshData &mesh)
+{
+    std::ifstream in(path);
+    if (in.fail())
+        return false;
+
+    struct VertexKey
+    {
+        int idx, tex_idx, n_idx;
+        bool operator==(const VertexKey &) const = default;
+    };
+    struct VertexKeyHash
+    {
+        size_t operator()(const VertexKey &k) const
+        {
+            return (static_cast<size_t>(k.idx) * 73856093u) ^ (static_cast<size_t>(k.tex_idx) * 19349663u) ^ (static_cast<size_t>(k.n_idx) * 83492791u);
+        }
+    };
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertex_lookup;
+    std::vector<Vec3f> vertices, normals;
+    std::vector<Vec2f> texture;
+    const Vec3f vertex_color = Vec3f{148.f, 121.f, 92.f} / 255.f;
+
+    std::string line;
+    while (!in.eof())
+    {
+        std::getline(in, line);
+        std::istringstream iss(line.c_str());
+        char trash;
+        if (!line.compare(0, 2, "v "))
+        {
+            iss >> trash;
+            Vec3f v;
+            for (int i = 0; i < 3; i++)
+                iss >> v.raw[i];
+            vertices.push_back(v);
+        }
+        else if (!line.compare(0, 3, "vt "))
+        {
+            iss >> trash >> trash;
+            Vec2f tex;
+            for (int i = 0; i < 2; i++)
+                iss >> tex.raw[i];
+            texture.push_back(tex);
+        }
+        else if (!line.compare(0, 3, "vn "))
+        {
+            iss >> trash >> trash;
+            Vec3f nor;
+            for (int i = 0; i < 3; i++)
+                iss >> nor.raw[i];
+            normals.push_back(nor);
+        }
+        else if (!line.compare(0, 2, "f "))
+        {
+            std::vector<uint32_t> face;
+            int idx, tex_idx, n_idx;
+            iss >> trash;
+            while (iss >> idx >> trash >> tex_idx >> trash >> n_idx)
+            {
+                idx--, tex_idx--, n_idx--;
+                if (idx < 0 || tex_idx < 0 || n_idx < 0 || static_cast<size_t>(n_idx) >= normals.size())
+                    return false;
+                auto [it, inserted] = vertex_lookup.try_emplace({idx, tex_idx, n_idx}, static_cast<uint32_t>(mesh.vertex_count()));
+                if (inserted)
+                {
+                    mesh.positions.push_back(vertices[idx]);
+                    mesh.normals.push_back(normals[n_idx]);
+                    mesh.tex_coords.push_back(texture[tex_idx]);
+                    mesh.colors.push_back(vertex_color);
+                }
+                face.push_back(it->second);
+            }
+            for (size_t i = 1; i + 1 < face.size(); ++i)
+                mesh.indices.insert(mesh.indices.end(), {face[0], face[i], face[i + 1]});
+        }
+    }
+    return true;
+}
+
+// 反复加载直到累计时间超过 min_ms，返回单次加载的最短耗时（毫秒）
+template <class Load>
+static double measure(double min_ms, const Load &load)
+{
+    double best = 1e30, total = 0.;
+    for (int run = 0; run < 3 || total < min_ms; ++run)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        if (!load())
+            return -1.;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        best = std::min(best, ms);
+        total += ms;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    std::filesystem::path root = argc > 1 ? argv[1] : "obj";
+    double min_ms = argc > 2 ? std::stod(argv[2]) : 200.;
+
+    std::vector<std::filesystem::path> files;
+    if (std::filesystem::is_directory(root))
+    {
+        for (const auto &entry : std::filesystem::recursive_directory_iterator(root))
+            if (entry.is_regular_file() && entry.path().extension() == ".obj")
+                files.push_back(entry.path());
+    }
+    else
+        files.push_back(root);
+    std::sort(files.begin(), files.end());
+    if (files.empty())
+    {
+        LOGE("No .obj files found in {}", root.string());
+        return 1;
+    }
+
+    // 加载器的日志写到 stderr，基准结果写到 stdout
+    printf("%-44s %10s %10s %12s %12s %12s %8s\n", "file", "KB", "triangles", "legacy MB/s", "mmap MB/s", "cached MB/s", "speedup");
+    double legacy_total_ms = 0., mmap_total_ms = 0., cached_total_ms = 0., total_mb = 0.;
+    for (const auto &file : files)
+    {
+        const std::string path = file.string();
+        const double mb = static_cast<double>(std::filesystem::file_size(file)) / (1024. * 1024.);
+        size_t triangles = 0;
+
+        double legacy_ms = measure(min_ms, [&]
+        {
+            MeshData mesh;
+            return legacy_load(path, mesh);
+        });
+        double mmap_ms = measure(min_ms, [&]
+        {
+            objl::Loader loader;
+            bool ok = loader.Load(path, false);
+            triangles = loader.LoadedMesh.triangle_count();
+            return ok;
+        });
+        // 先加载一次生成缓存，之后每次都命中缓存
+        objl::Loader().Load(path);
+        double cached_ms = measure(min_ms, [&]
+        {
+            objl::Loader loader;
+            return loader.Load(path);
+        });
+
+        printf("%-44s %10.1f %10zu ", path.c_str(), mb * 1024., triangles);
+        if (legacy_ms > 0.)
+            printf("%12.1f ", mb / legacy_ms * 1000.);
+        else
+            printf("%12s ", "failed");
+        if (mmap_ms > 0.)
+            printf("%12.1f ", mb / mmap_ms * 1000.);
+        else
+            printf("%12s ", "failed");
+        if (cached_ms > 0.)
+            printf("%12.1f ", mb / cached_ms * 1000.);
+        else
+            printf("%12s ", "failed");
+        if (legacy_ms > 0. && mmap_ms > 0. && cached_ms > 0.)
+        {
+            printf("%7.1fx", legacy_ms / mmap_ms);
+            legacy_total_ms += legacy_ms;
+            mmap_total_ms += mmap_ms;
+            cached_total_ms += cached_ms;
+            total_mb += mb;
+        }
+        printf("\n");
+    }
+    if (total_mb > 0.)
+        printf("%-44s %10.1f %10s %12.1f %12.1f %12.1f %7.1fx\n", "total (files all loaders read)", total_mb * 1024., "",
+               total_mb / legacy_total_ms * 1000., total_mb / mmap_total_ms * 1000., total_mb / cached_total_ms * 1000.,
+               legacy_total_ms / mmap_total_ms);
+
+    // 解析线程数从 1 开始翻倍直到核心数
+    const auto largest = *std::max_element(files.begin(), files.end(), [](const auto &a, const auto &b)
+    {
+        return std::filesystem::file_size(a) < std::filesystem::file_size(b);
+    });
+    const double largest_mb = static_cast<double>(std::filesystem::file_size(largest)) / (1024. * 1024.);
+    const unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+    printf("\nparse scaling: %s\n%-10s %12s %8s\n", largest.string().c_str(), "threads", "MB/s", "speedup");
+    std::vector<unsigned> thread_counts;
+    for (unsigned threads = 1; threads < max_threads; threads *= 2)
+        thread_counts.push_back(threads);
+    thread_counts.push_back(max_threads);
+    double single_ms = 0.;
+    for (unsigned threads : thread_counts)
+    {
+        double ms = measure(min_ms, [&]
+        {
+            objl::Loader loader;
+            loader.parse_threads = threads;
+            return loader.Load(largest.string(), false);
+        });
+        if (ms <= 0.)
+            break;
+        if (threads == 1)
+            single_ms = ms;
+        printf("%-10u %12.1f %7.1fx\n", threads, largest_mb / ms * 1000., single_ms / ms);
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+// 纹理采样基准测试
+// 对比原先直接从 cv::Mat 逐行读取的最近点采样与 Texture 分块 Morton 存储下的最近点/双线性/三线性采样，
+// 分别按横向、纵向、斜向扫描和随机访问四种模式取样，输出每次采样的平均耗时
+// 用法：texture_bench [纹理路径] [采样次数]
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include "Texture.h"
+
+// 原先 Texture::getColor 的实现：cv::Mat 逐行存放 BGR 字节，每次采样都经过 at<> 并转换成 Vec3f
+static Vec3f mat_get_color(const cv::Mat &image, float u, float v)
+{
+    u = std::clamp(u, 0.0f, 1.0f);
+    v = std::clamp(v, 0.0f, 1.0f);
+
+    auto u_img = static_cast<int>(u * (image.cols - 1));
+    auto v_img = static_cast<int>((1 - v) * (image.rows - 1));
+
+    auto color = image.at<cv::Vec3b>(v_img, u_img);
+    return Vec3f{static_cast<float>(color[0]), static_cast<float>(color[1]), static_cast<float>(color[2])};
+}
+
+// 一种访问模式：预先生成的 uv 序列
+struct pattern
+{
+    const char *name;
+    std::vector<Vec2f> uv;
+};
+
+// 按扫描线依次访问纹素中心：沿扫描线每次前进一个纹素，相邻扫描线隔开 7 个纹素，避免重复命中同一批缓存行
+// dy_per_x 为 0 时横向扫描，transpose 为真时纵向扫描，dy_per_x 为 1 时沿 45° 斜线扫描
+static pattern make_scan(const char *name, size_t count, int size, int dy_per_x, bool transpose)
+{
+    pattern p{name, {}};
+    p.uv.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        int x = static_cast<int>(i % size);
+        int y = static_cast<int>((x * dy_per_x + (i / size) * 7) % size);
+        float u = (x + 0.5f) / size, v = (y + 0.5f) / size;
+        p.uv.push_back(transpose ? Vec2f{v, u} : Vec2f{u, v});
+    }
+    return p;
+}
+
+static pattern make_random(size_t count)
+{
+    pattern p{"random", {}};
+    p.uv.reserve(count);
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> dist(0.f, 1.f);
+    for (size_t i = 0; i < count; ++i)
+        p.uv.push_back(Vec2f{dist(rng), dist(rng)});
+    return p;
+}
+
+// 多次运行取最快的一次，返回每次采样的纳秒数；checksum 防止采样被编译器优化掉
+template <class Sampler>
+static double measure(const pattern &p, const Sampler &sample, float &checksum)
+{
+    double best = 1e30;
+    for (int run = 0; run < 5; ++run)
+    {
+        float sum = 0.f;
+        auto begin = std::chrono::steady_clock::now();
+        for (const auto &uv : p.uv)
+        {
+            Vec3f c = sample(uv.x, uv.y);
+            sum += c.x + c.y + c.z;
+        }
+        auto end = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(end - begin).count() / p.uv.size());
+        checksum += sum;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    std::string path = argc > 1 ? argv[1] : "obj/Texture/diffuse.jpg";
+    size_t count = argc > 2 ? std::stoul(argv[2]) : (1u << 22);
+
+    cv::Mat image = cv::imread(path);
+    if (image.empty())
+    {
+        LOGE("Failed to load texture: {}", path);
+        return 1;
+    }
+    cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+    Texture texture(path);
+    printf("%s: %dx%d, %d mip levels, %zu KB tiled storage\n", path.c_str(), texture.getWidth(), texture.getHeight(),
+           texture.getLevelCount(), texture.getMemoryBytes() / 1024);
+
+    const int size = std::max(texture.getWidth(), texture.getHeight());
+    std::vector<pattern> patterns;
+    patterns.push_back(make_scan("horizontal", count, size, 0, false));
+    patterns.push_back(make_scan("vertical", count, size, 0, true));
+    patterns.push_back(make_scan("diagonal", count, size, 1, false));
+    patterns.push_back(make_random(count));
+
+    float checksum = 0.f;
+    printf("%-28s", "ns / sample");
+    for (const auto &p : patterns)
+        printf("%12s", p.name);
+    printf("\n");
+
+    // 每种采样方式在所有访问模式下各测一次
+    auto run = [&](const char *name, const auto &sample)
+    {
+        printf("%-28s", name);
+        for (const auto &p : patterns)
+            printf("%12.2f", measure(p, sample, checksum));
+        printf("\n");
+    };
+    run("cv::Mat nearest", [&](float u, float v) { return mat_get_color(image, u, v); });
+    run("tiled nearest", [&](float u, float v) { return texture.getColor(u, v); });
+    run("tiled bilinear", [&](float u, float v) { return texture.getColorBilinear(u, v, 0); });
+    run("tiled trilinear lod 1.5", [&](float u, float v) { return texture.getColorTrilinear(u, v, 1.5f); });
+
+    printf("checksum %g\n", checksum);
+    return 0;
+}
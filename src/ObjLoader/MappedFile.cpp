@@ -0,0 +1,120 @@
+﻿#include "MappedFile.h"
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string &path)
+{
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        file = nullptr;
+        return;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        close();
+        return;
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    opened = true;
+    if (length == 0) // 空文件无法建立映射，按长度为 0 的内容处理
+        return;
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    bytes = mapping ? static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (bytes == nullptr)
+        close();
+}
+
+void MappedFile::close()
+{
+    if (bytes)
+        UnmapViewOfFile(bytes);
+    if (mapping)
+        CloseHandle(mapping);
+    if (file)
+        CloseHandle(file);
+    bytes = nullptr;
+    mapping = file = nullptr;
+    length = 0;
+    opened = false;
+}
+#else
+MappedFile::MappedFile(const std::string &path)
+{
+    fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close();
+        return;
+    }
+    length = static_cast<size_t>(st.st_size);
+    opened = true;
+    if (length == 0) // 空文件无法建立映射，按长度为 0 的内容处理
+        return;
+
+    void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (address == MAP_FAILED)
+    {
+        close();
+        return;
+    }
+    bytes = static_cast<const char *>(address);
+    madvise(address, length, MADV_SEQUENTIAL); // 文件从头到尾顺序扫描，提示内核提前预读
+}
+
+void MappedFile::close()
+{
+    if (bytes)
+        munmap(const_cast<char *>(bytes), length);
+    if (fd >= 0)
+        ::close(fd);
+    bytes = nullptr;
+    fd = -1;
+    length = 0;
+    opened = false;
+}
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        std::swap(bytes, other.bytes);
+        std::swap(length, other.length);
+        std::swap(opened, other.opened);
+#ifdef _WIN32
+        std::swap(file, other.file);
+        std::swap(mapping, other.mapping);
+#else
+        std::swap(fd, other.fd);
+#endif
+    }
+    return *this;
+}
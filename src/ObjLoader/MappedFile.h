@@ -0,0 +1,34 @@
+﻿#pragma once
+#include <cstddef>
+#include <string>
+
+// 只读的内存映射文件：整个文件映射进进程地址空间，由操作系统按页读入，读取时不经过流缓冲，也没有额外拷贝
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &path); // 打开失败时 is_open() 为 false
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool is_open() const { return opened; }
+    const char *data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    void close();
+
+    const char *bytes = nullptr;
+    size_t length = 0;
+    bool opened = false;
+#ifdef _WIN32
+    void *file = nullptr;    // HANDLE
+    void *mapping = nullptr; // HANDLE
+#else
+    int fd = -1;
+#endif
+};
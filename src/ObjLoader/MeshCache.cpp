@@ -0,0 +1,179 @@
+﻿#include "MeshCache.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include "Log.hpp"
+#include "MappedFile.h"
+
+namespace
+{
+    constexpr char cache_magic[8] = {'T', 'R', 'M', 'E', 'S', 'H', '\0', '\0'};
+    constexpr uint32_t cache_version = 1;
+    constexpr uint64_t stream_alignment = 64; // 每个流从一条缓存行的开头开始
+
+    enum Stream
+    {
+        Positions,
+        Normals,
+        TexCoords,
+        Colors,
+        Tangents,
+        Indices,
+        StreamCount
+    };
+    // 各流中一个元素的字节数：Vec2f 与 Vec3f 共用 x、y、z 的联合体，也占 12 字节
+    constexpr uint32_t element_sizes[StreamCount] = {sizeof(Vec3f), sizeof(Vec3f), sizeof(Vec2f), sizeof(Vec3f), sizeof(Vec4f), sizeof(uint32_t)};
+
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t element_sizes[StreamCount];
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint64_t counts[StreamCount];  // 各流的元素个数
+        uint64_t offsets[StreamCount]; // 各流相对文件开头的字节偏移
+        float bounds_min[3], bounds_max[3];
+    };
+
+    // 源文件的大小和修改时间，取不到时返回 false
+    bool source_stamp(const std::string &source_path, uint64_t &size, int64_t &mtime)
+    {
+        std::error_code error;
+        size = std::filesystem::file_size(source_path, error);
+        if (error)
+            return false;
+        auto time = std::filesystem::last_write_time(source_path, error);
+        if (error)
+            return false;
+        mtime = static_cast<int64_t>(time.time_since_epoch().count());
+        return true;
+    }
+
+    template <class T>
+    std::span<const T> stream_view(const char *base, const CacheHeader &header, Stream stream)
+    {
+        return {reinterpret_cast<const T *>(base + header.offsets[stream]), static_cast<size_t>(header.counts[stream])};
+    }
+}
+
+bool objl::read_mesh_cache(const std::string &cache_path, const std::string &source_path, Mesh &mesh)
+{
+    uint64_t source_size;
+    int64_t source_mtime;
+    if (!source_stamp(source_path, source_size, source_mtime))
+        return false;
+
+    auto file = std::make_shared<MappedFile>(cache_path);
+    if (!file->is_open() || file->size() < sizeof(CacheHeader))
+        return false;
+    CacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version ||
+        std::memcmp(header.element_sizes, element_sizes, sizeof(element_sizes)) != 0)
+    {
+        LOGI("mesh cache format changed, rebuilding: {}", cache_path);
+        return false;
+    }
+    if (header.source_size != source_size || header.source_mtime != source_mtime)
+    {
+        LOGI("mesh cache is stale, rebuilding: {}", cache_path);
+        return false;
+    }
+
+    // 每个流都必须对齐并完整地落在文件内；顶点属性流的长度一致，切线可以没有
+    const uint64_t vertex_count = header.counts[Positions];
+    bool valid = header.counts[Normals] == vertex_count && header.counts[TexCoords] == vertex_count && header.counts[Colors] == vertex_count &&
+                 (header.counts[Tangents] == vertex_count || header.counts[Tangents] == 0) && header.counts[Indices] % 3 == 0;
+    for (int s = 0; s < StreamCount && valid; ++s)
+        valid = header.offsets[s] % stream_alignment == 0 && header.offsets[s] <= file->size() &&
+                header.counts[s] <= (file->size() - header.offsets[s]) / element_sizes[s];
+    if (!valid)
+    {
+        LOGE("Corrupted mesh cache: {}", cache_path);
+        return false;
+    }
+
+    const char *base = file->data();
+    mesh.positions = stream_view<Vec3f>(base, header, Positions);
+    mesh.normals = stream_view<Vec3f>(base, header, Normals);
+    mesh.tex_coords = stream_view<Vec2f>(base, header, TexCoords);
+    mesh.colors = stream_view<Vec3f>(base, header, Colors);
+    mesh.tangents = stream_view<Vec4f>(base, header, Tangents);
+    mesh.indices = stream_view<uint32_t>(base, header, Indices);
+    mesh.bounds_min = Vec3f{header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]};
+    mesh.bounds_max = Vec3f{header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]};
+    mesh.storage = std::move(file); // 映射随 Mesh 的最后一个拷贝一起释放
+    return true;
+}
+
+bool objl::write_mesh_cache(const std::string &cache_path, const std::string &source_path, const Mesh &mesh)
+{
+    CacheHeader header{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    std::memcpy(header.element_sizes, element_sizes, sizeof(element_sizes));
+    if (!source_stamp(source_path, header.source_size, header.source_mtime))
+        return false;
+    for (int i = 0; i < 3; ++i)
+    {
+        header.bounds_min[i] = mesh.bounds_min.raw[i];
+        header.bounds_max[i] = mesh.bounds_max.raw[i];
+    }
+
+    const void *streams[StreamCount] = {mesh.positions.data(), mesh.normals.data(), mesh.tex_coords.data(),
+                                        mesh.colors.data(), mesh.tangents.data(), mesh.indices.data()};
+    const size_t counts[StreamCount] = {mesh.positions.size(), mesh.normals.size(), mesh.tex_coords.size(),
+                                        mesh.colors.size(), mesh.tangents.size(), mesh.indices.size()};
+    uint64_t offset = sizeof(CacheHeader);
+    for (int s = 0; s < StreamCount; ++s)
+    {
+        offset = (offset + stream_alignment - 1) / stream_alignment * stream_alignment;
+        header.counts[s] = counts[s];
+        header.offsets[s] = offset;
+        offset += counts[s] * element_sizes[s];
+    }
+
+    const std::string temp_path = cache_path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        uint64_t written = sizeof(header);
+        const char padding[stream_alignment] = {};
+        for (int s = 0; s < StreamCount && out; ++s)
+        {
+            out.write(padding, static_cast<std::streamsize>(header.offsets[s] - written));
+            if (s == TexCoords)
+            {
+                // Vec2f 的第三个 float 没有初始化，按 0 写出，缓存内容只由网格决定
+                for (const Vec2f &uv : mesh.tex_coords)
+                {
+                    float element[sizeof(Vec2f) / sizeof(float)] = {uv.x, uv.y};
+                    out.write(reinterpret_cast<const char *>(element), sizeof(element));
+                }
+            }
+            else
+                out.write(static_cast<const char *>(streams[s]), static_cast<std::streamsize>(counts[s] * element_sizes[s]));
+            written = header.offsets[s] + counts[s] * element_sizes[s];
+        }
+        if (!out)
+        {
+            out.close();
+            std::error_code ignored;
+            std::filesystem::remove(temp_path, ignored);
+            LOGE("Failed to write mesh cache: {}", cache_path);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temp_path, cache_path, error);
+    if (error)
+    {
+        std::filesystem::remove(temp_path, error);
+        LOGE("Failed to write mesh cache: {}", cache_path);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,13 @@
+﻿#pragma once
+#include <string>
+#include "Mesh.hpp"
+
+namespace objl
+{
+    // 二进制网格缓存：文件头、按 64 字节对齐的各顶点属性流、索引流和包围盒。属性流的内存布局与 Mesh 中的完全相同，
+    // 读取时整个文件映射进内存，Mesh 的视图直接指向映射的内容，不做解析和拷贝
+    // 文件头记录格式版本、各元素的字节数以及源文件的大小和修改时间，任意一项不符都视为过期
+    bool read_mesh_cache(const std::string &cache_path, const std::string &source_path, Mesh &mesh);
+    // 先写到临时文件再改名，写到一半失败不会留下损坏的缓存
+    bool write_mesh_cache(const std::string &cache_path, const std::string &source_path, const Mesh &mesh);
+}
@@ -0,0 +1,379 @@
+﻿#include "MeshSimplify.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include "Log.hpp"
+
+namespace
+{
+    constexpr uint32_t no_vertex = std::numeric_limits<uint32_t>::max();
+    constexpr double border_weight = 10.; // 开放边界约束平面的权重，边界轮廓比曲面本身更不容易被简化掉
+
+    // 二次误差：点到一组平面距离平方的加权和，对称 4x4 矩阵只保存上三角的 10 个元素
+    struct Quadric
+    {
+        double a2 = 0., ab = 0., ac = 0., ad = 0., b2 = 0., bc = 0., bd = 0., c2 = 0., cd = 0., d2 = 0.;
+
+        // 平面 n·p + d = 0，n 为单位向量
+        static Quadric plane(const Vec3f &n, double d, double weight)
+        {
+            const double a = n.x, b = n.y, c = n.z;
+            return {a * a * weight, a * b * weight, a * c * weight, a * d * weight, b * b * weight,
+                    b * c * weight, b * d * weight, c * c * weight, c * d * weight, d * d * weight};
+        }
+
+        Quadric &operator+=(const Quadric &q)
+        {
+            a2 += q.a2, ab += q.ab, ac += q.ac, ad += q.ad, b2 += q.b2;
+            bc += q.bc, bd += q.bd, c2 += q.c2, cd += q.cd, d2 += q.d2;
+            return *this;
+        }
+
+        double error(const Vec3f &p) const
+        {
+            const double x = p.x, y = p.y, z = p.z;
+            const double e = a2 * x * x + 2. * ab * x * y + 2. * ac * x * z + 2. * ad * x + b2 * y * y +
+                             2. * bc * y * z + 2. * bd * y + c2 * z * z + 2. * cd * z + d2;
+            return std::max(e, 0.);
+        }
+    };
+
+    // 候选折叠：位置 from 并到位置 to；两端的版本号变化后代价已经过期，出队时丢弃
+    struct Collapse
+    {
+        double cost;
+        uint32_t from, to;
+        uint32_t from_version, to_version;
+
+        bool operator>(const Collapse &other) const { return std::tie(cost, from, to) > std::tie(other.cost, other.from, other.to); }
+    };
+
+    class Simplifier
+    {
+    public:
+        explicit Simplifier(const Mesh &mesh);
+        void run(size_t target_triangles);
+        Mesh result() const;
+
+    private:
+        const Mesh &mesh;
+        std::vector<uint32_t> wedge_position;                  // 顶点所在的位置：坐标完全相同的顶点共用一个位置
+        std::vector<Vec3f> positions;
+        std::vector<Quadric> quadrics;                         // 每个位置累积的误差
+        std::vector<uint32_t> versions;                        // 位置的误差或邻域每变化一次加一
+        std::vector<char> position_alive, border;              // border：位于开放边界上
+        std::vector<std::vector<uint32_t>> position_triangles; // 每个位置关联的三角形，可能含已删除的三角形
+        std::vector<std::array<uint32_t, 3>> triangles;        // 三角形的三个顶点，折叠时改写
+        std::vector<char> triangle_alive;
+        size_t live_triangles = 0;
+        std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> heap;
+        // try_collapse 每次调用复用的临时数组
+        std::vector<uint32_t> u_neighbors, v_neighbors;
+        std::vector<std::pair<uint32_t, uint32_t>> wedge_map; // u 上的顶点 -> 并过去的 v 上的顶点
+
+        void collect_neighbors(uint32_t p, std::vector<uint32_t> &result) const;
+        bool contains_position(uint32_t t, uint32_t p) const;
+        void push_collapse(uint32_t from, uint32_t to);
+        bool try_collapse(uint32_t u, uint32_t v);
+    };
+
+    Simplifier::Simplifier(const Mesh &mesh) : mesh(mesh)
+    {
+        // 坐标完全相同的顶点（接缝两侧的拷贝）合并成一个位置，简化在位置上进行
+        struct PositionKey
+        {
+            uint32_t x, y, z;
+            bool operator==(const PositionKey &) const = default;
+        };
+        struct PositionKeyHash
+        {
+            size_t operator()(const PositionKey &k) const
+            {
+                return (static_cast<size_t>(k.x) * 73856093u) ^ (static_cast<size_t>(k.y) * 19349663u) ^ (static_cast<size_t>(k.z) * 83492791u);
+            }
+        };
+        std::unordered_map<PositionKey, uint32_t, PositionKeyHash> position_lookup;
+        wedge_position.resize(mesh.vertex_count());
+        for (size_t w = 0; w < mesh.vertex_count(); ++w)
+        {
+            const Vec3f &p = mesh.positions[w];
+            PositionKey key{std::bit_cast<uint32_t>(p.x), std::bit_cast<uint32_t>(p.y), std::bit_cast<uint32_t>(p.z)};
+            auto [it, inserted] = position_lookup.try_emplace(key, static_cast<uint32_t>(positions.size()));
+            if (inserted)
+                positions.push_back(p);
+            wedge_position[w] = it->second;
+        }
+        const size_t position_count = positions.size();
+        quadrics.resize(position_count);
+        versions.assign(position_count, 0);
+        position_alive.assign(position_count, 1);
+        border.assign(position_count, 0);
+        position_triangles.resize(position_count);
+
+        // 每个三角形的平面按面积加权累加到三个顶点；只有一个三角形的边是开放边界，再加一个过该边、垂直于三角形的约束平面
+        std::unordered_map<uint64_t, uint32_t> edge_triangles; // 边（两端位置）-> 使用它的三角形，第二个三角形出现时置为 no_vertex
+        triangles.resize(mesh.triangle_count());
+        triangle_alive.assign(mesh.triangle_count(), 0);
+        for (size_t t = 0; t < mesh.triangle_count(); ++t)
+        {
+            auto &tri = triangles[t];
+            tri = {mesh.indices[t * 3], mesh.indices[t * 3 + 1], mesh.indices[t * 3 + 2]};
+            const uint32_t p[3] = {wedge_position[tri[0]], wedge_position[tri[1]], wedge_position[tri[2]]};
+            if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) // 退化的三角形不参与简化，直接丢弃
+                continue;
+            triangle_alive[t] = 1;
+            ++live_triangles;
+            for (int k = 0; k < 3; ++k)
+            {
+                position_triangles[p[k]].push_back(static_cast<uint32_t>(t));
+                const uint64_t edge = (static_cast<uint64_t>(std::min(p[k], p[(k + 1) % 3])) << 32) | std::max(p[k], p[(k + 1) % 3]);
+                auto [it, inserted] = edge_triangles.try_emplace(edge, static_cast<uint32_t>(t));
+                if (!inserted)
+                    it->second = no_vertex;
+            }
+
+            Vec3f normal = (positions[p[1]] - positions[p[0]]) ^ (positions[p[2]] - positions[p[0]]);
+            const float double_area = normal.norm();
+            if (double_area == 0.f)
+                continue;
+            normal = normal / double_area;
+            const Quadric q = Quadric::plane(normal, -(normal * positions[p[0]]), double_area * 0.5);
+            for (int k = 0; k < 3; ++k)
+                quadrics[p[k]] += q;
+        }
+        for (const auto &[edge, t] : edge_triangles)
+        {
+            if (t == no_vertex)
+                continue;
+            const uint32_t a = static_cast<uint32_t>(edge >> 32), b = static_cast<uint32_t>(edge);
+            border[a] = border[b] = 1;
+            const auto &tri = triangles[t];
+            Vec3f normal = (positions[wedge_position[tri[1]]] - positions[wedge_position[tri[0]]]) ^
+                           (positions[wedge_position[tri[2]]] - positions[wedge_position[tri[0]]]);
+            Vec3f e = positions[b] - positions[a];
+            Vec3f side = e ^ normal;
+            const float side_length = side.norm();
+            if (side_length == 0.f)
+                continue;
+            side = side / side_length;
+            const Quadric q = Quadric::plane(side, -(side * positions[a]), border_weight * (e * e));
+            quadrics[a] += q;
+            quadrics[b] += q;
+        }
+
+        for (size_t t = 0; t < triangles.size(); ++t)
+            if (triangle_alive[t])
+                for (int k = 0; k < 3; ++k)
+                {
+                    const uint32_t a = wedge_position[triangles[t][k]], b = wedge_position[triangles[t][(k + 1) % 3]];
+                    push_collapse(a, b);
+                    push_collapse(b, a);
+                }
+    }
+
+    bool Simplifier::contains_position(uint32_t t, uint32_t p) const
+    {
+        const auto &tri = triangles[t];
+        return wedge_position[tri[0]] == p || wedge_position[tri[1]] == p || wedge_position[tri[2]] == p;
+    }
+
+    // 与位置 p 相连的其他位置，升序且不重复
+    void Simplifier::collect_neighbors(uint32_t p, std::vector<uint32_t> &result) const
+    {
+        result.clear();
+        for (uint32_t t : position_triangles[p])
+            if (triangle_alive[t])
+                for (uint32_t w : triangles[t])
+                    if (wedge_position[w] != p)
+                        result.push_back(wedge_position[w]);
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+    }
+
+    void Simplifier::push_collapse(uint32_t from, uint32_t to)
+    {
+        // 半边折叠后剩下 to 的坐标，代价是两端误差之和在该处的值
+        const double cost = quadrics[from].error(positions[to]) + quadrics[to].error(positions[to]);
+        heap.push({cost, from, to, versions[from], versions[to]});
+    }
+
+    bool Simplifier::try_collapse(uint32_t u, uint32_t v)
+    {
+        auto &u_triangles = position_triangles[u];
+        auto &v_triangles = position_triangles[v];
+        std::erase_if(u_triangles, [&](uint32_t t) { return !triangle_alive[t]; });
+
+        // 共享边 uv 的三角形：折叠后被删除
+        size_t shared = 0;
+        for (uint32_t t : u_triangles)
+            shared += contains_position(t, v);
+        if (shared == 0)
+            return false;
+        // 开放边界上的位置只能沿边界折叠，否则边界会向内收缩或出现破洞
+        if (border[u] && !(shared == 1 && border[v]))
+            return false;
+
+        // 连接条件：u、v 共同的邻居只能是共享边三角形的第三个顶点，否则折叠后网格会粘连成非流形
+        collect_neighbors(u, u_neighbors);
+        collect_neighbors(v, v_neighbors);
+        size_t common = 0;
+        for (size_t i = 0, j = 0; i < u_neighbors.size() && j < v_neighbors.size();)
+        {
+            if (u_neighbors[i] < v_neighbors[j])
+                ++i;
+            else if (u_neighbors[i] > v_neighbors[j])
+                ++j;
+            else
+                ++common, ++i, ++j;
+        }
+        if (common > shared)
+            return false;
+
+        // u 上的每个顶点（接缝两侧各有一个）都要在共享边的三角形中找到对应的 v 上的顶点，属性才能连续地并过去
+        wedge_map.clear();
+        auto wedge_at = [&](uint32_t t, uint32_t p)
+        {
+            for (uint32_t w : triangles[t])
+                if (wedge_position[w] == p)
+                    return w;
+            return no_vertex;
+        };
+        for (uint32_t t : u_triangles)
+        {
+            const uint32_t wv = wedge_at(t, v);
+            if (wv == no_vertex)
+                continue;
+            const uint32_t wu = wedge_at(t, u);
+            auto it = std::find_if(wedge_map.begin(), wedge_map.end(), [&](const auto &m) { return m.first == wu; });
+            if (it == wedge_map.end())
+                wedge_map.emplace_back(wu, wv);
+            else if (it->second != wv)
+                return false;
+        }
+        for (uint32_t t : u_triangles)
+        {
+            const uint32_t wu = wedge_at(t, u);
+            if (std::none_of(wedge_map.begin(), wedge_map.end(), [&](const auto &m) { return m.first == wu; }))
+                return false;
+        }
+
+        // 保留下来的三角形不能翻面
+        for (uint32_t t : u_triangles)
+        {
+            if (contains_position(t, v))
+                continue;
+            Vec3f p[3], q[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t position = wedge_position[triangles[t][k]];
+                p[k] = positions[position];
+                q[k] = position == u ? positions[v] : p[k];
+            }
+            const Vec3f before = (p[1] - p[0]) ^ (p[2] - p[0]);
+            const Vec3f after = (q[1] - q[0]) ^ (q[2] - q[0]);
+            if (before * after <= 0.f)
+                return false;
+        }
+
+        // 折叠：共享边的三角形删除，其余三角形中 u 的顶点换成对应的 v 的顶点
+        for (uint32_t t : u_triangles)
+        {
+            if (contains_position(t, v))
+            {
+                triangle_alive[t] = 0;
+                --live_triangles;
+                continue;
+            }
+            for (uint32_t &w : triangles[t])
+                if (wedge_position[w] == u)
+                    w = std::find_if(wedge_map.begin(), wedge_map.end(), [&](const auto &m) { return m.first == w; })->second;
+            v_triangles.push_back(t);
+        }
+        std::erase_if(v_triangles, [&](uint32_t t) { return !triangle_alive[t]; });
+        u_triangles.clear();
+        position_alive[u] = 0;
+        quadrics[v] += quadrics[u];
+        ++versions[v];
+
+        // v 的误差变了，与 v 相连的边重新计算代价
+        collect_neighbors(v, v_neighbors);
+        for (uint32_t n : v_neighbors)
+        {
+            push_collapse(v, n);
+            push_collapse(n, v);
+        }
+        return true;
+    }
+
+    void Simplifier::run(size_t target_triangles)
+    {
+        while (live_triangles > target_triangles && !heap.empty())
+        {
+            const Collapse c = heap.top();
+            heap.pop();
+            if (!position_alive[c.from] || !position_alive[c.to] || versions[c.from] != c.from_version || versions[c.to] != c.to_version)
+                continue;
+            try_collapse(c.from, c.to);
+        }
+    }
+
+    Mesh Simplifier::result() const
+    {
+        // 只保留仍被三角形引用的顶点，按第一次被引用的顺序重新编号
+        MeshData data;
+        const bool has_tangents = mesh.tangents.size() == mesh.vertex_count();
+        std::vector<uint32_t> remap(mesh.vertex_count(), no_vertex);
+        data.indices.reserve(live_triangles * 3);
+        for (size_t t = 0; t < triangles.size(); ++t)
+        {
+            if (!triangle_alive[t])
+                continue;
+            for (uint32_t w : triangles[t])
+            {
+                if (remap[w] == no_vertex)
+                {
+                    remap[w] = static_cast<uint32_t>(data.positions.size());
+                    data.positions.push_back(mesh.positions[w]);
+                    data.normals.push_back(mesh.normals[w]);
+                    data.tex_coords.push_back(mesh.tex_coords[w]);
+                    data.colors.push_back(mesh.colors[w]);
+                    if (has_tangents)
+                        data.tangents.push_back(mesh.tangents[w]);
+                }
+                data.indices.push_back(remap[w]);
+            }
+        }
+        return Mesh(std::move(data));
+    }
+}
+
+Mesh objl::simplify_mesh(const Mesh &mesh, size_t target_triangles)
+{
+    Simplifier simplifier(mesh);
+    simplifier.run(target_triangles);
+    return simplifier.result();
+}
+
+std::vector<Mesh> objl::build_lod_chain(const Mesh &mesh, size_t min_triangles)
+{
+    std::vector<Mesh> lods;
+    while (true)
+    {
+        const Mesh &previous = lods.empty() ? mesh : lods.back();
+        if (previous.triangle_count() <= min_triangles)
+            break;
+        Mesh lod = simplify_mesh(previous, std::max(min_triangles, previous.triangle_count() / 2));
+        // 剩下的折叠都会破坏接缝、边界或拓扑时简化提前停止，减少得太少就不再生成下一级
+        if (lod.triangle_count() * 10 > previous.triangle_count() * 9)
+            break;
+        lods.push_back(std::move(lod));
+    }
+    LOGI("mesh lod chain: {} levels, {} -> {} triangles", lods.size() + 1, mesh.triangle_count(),
+         lods.empty() ? mesh.triangle_count() : lods.back().triangle_count());
+    return lods;
+}
@@ -0,0 +1,15 @@
+﻿#pragma once
+#include <vector>
+#include "Mesh.hpp"
+
+namespace objl
+{
+    // 二次误差度量（QEM）的半边折叠简化：每次把代价最小的一条边的一端并到另一端，直到三角形数不超过 target_triangles
+    // 顶点只会并到已有的顶点上，保留下来的顶点沿用原来的位置和全部属性；同一位置上的多个顶点（UV/法线接缝）一起折叠，
+    // 接缝和开放边界只沿自身折叠，不会裂开；会让三角形翻面或网格粘连的折叠被跳过，因此可能达不到目标三角形数
+    Mesh simplify_mesh(const Mesh &mesh, size_t target_triangles);
+
+    // 逐级简化的 LOD 链：每级的三角形数约为上一级的一半，直到不超过 min_triangles 或无法继续简化
+    // 返回的第 i 个元素是第 i + 1 级，不包含原网格本身
+    std::vector<Mesh> build_lod_chain(const Mesh &mesh, size_t min_triangles = 256);
+}
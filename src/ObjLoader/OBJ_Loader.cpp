@@ -1,106 +1,663 @@
 ﻿#include "OBJ_Loader.h"
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include "MappedFile.h"
+#include "MeshCache.h"
 
-bool objl::Loader::Load(const std::string &path)
+namespace
 {
-    if (path.substr(path.size() - 4, 4) != ".obj") {
-        LOGE("the file is not an .obj file");
-        return false;
+    // 手写的扫描函数：按字节前进，不做任何内存分配；数字交给 std::from_chars 解析，不受 locale 影响
+    // 解析一行时 end 取这一行的行尾，数字不会跨行读取
+    inline bool is_blank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+    inline const char *skip_blanks(const char *p, const char *end)
+    {
+        while (p < end && is_blank(*p))
+            ++p;
+        return p;
     }
-        
-    // 读取模型文件
-    std::ifstream in;
-    in.open(path, std::ifstream::in);
-    if (in.fail())
+
+    inline const char *find_line_end(const char *p, const char *end)
     {
-        LOGE("Failed to open file: {}", path);
-        return false;
+        const void *newline = std::memchr(p, '\n', static_cast<size_t>(end - p));
+        return newline ? static_cast<const char *>(newline) : end;
     }
 
-    // 读取模型文件的每一行
-    std::string line;
-    while (!in.eof())
+    template <class T>
+    inline bool parse_number(const char *&p, const char *end, T &value)
     {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash; // 用于读取无用字符
+        if (p < end && *p == '+') // from_chars 不接受正号
+            ++p;
+        auto [ptr, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc())
+            return false;
+        p = ptr;
+        return true;
+    }
 
-        if (!line.compare(0, 2, "v ")) // 顶点
+    template <size_t N>
+    inline bool parse_floats(const char *p, const char *end, Vec<float, N> &value)
+    {
+        for (size_t i = 0; i < N; ++i)
         {
-            iss >> trash;
-            Vec3f v;
-            for (int i = 0; i < 3; i++) {
-                iss >> v.raw[i];
-            }
+            p = skip_blanks(p, end);
+            if (!parse_number(p, end, value.raw[i]))
+                return false;
+        }
+        return true;
+    }
 
-            _Vertices.push_back(v);
+    enum class LineType
+    {
+        Other,
+        Vertex,   // v
+        TexCoord, // vt
+        Normal,   // vn
+        Face      // f
+    };
+
+    // 识别行首的关键字，p 移到关键字之后
+    inline LineType classify(const char *&p, const char *end)
+    {
+        p = skip_blanks(p, end);
+        if (end - p < 2)
+            return LineType::Other;
+        if (p[0] == 'f' && is_blank(p[1]))
+        {
+            p += 1;
+            return LineType::Face;
         }
-        else if (!line.compare(0, 3, "vt ")) // 纹理坐标
+        if (p[0] != 'v')
+            return LineType::Other;
+        if (is_blank(p[1]))
         {
-            iss >> trash >> trash;
-            Vec2f tex;
-            for (int i = 0; i < 2; i++) {
-                iss >> tex.raw[i];
-            }
+            p += 1;
+            return LineType::Vertex;
+        }
+        if (end - p < 3 || !is_blank(p[2]))
+            return LineType::Other;
+        p += 2;
+        return p[-1] == 't' ? LineType::TexCoord : p[-1] == 'n' ? LineType::Normal : LineType::Other;
+    }
 
-            _Texture.push_back(tex);
+    // 一行面中顶点（以空白分隔的记号）的个数
+    inline size_t count_tokens(const char *p, const char *end)
+    {
+        size_t count = 0;
+        for (p = skip_blanks(p, end); p < end; p = skip_blanks(p, end))
+        {
+            ++count;
+            while (p < end && !is_blank(*p))
+                ++p;
         }
-        else if (!line.compare(0, 3, "vn ")) // 法向量
+        return count;
+    }
+
+    // acos 的多项式近似（Abramowitz & Stegun 4.4.45），误差小于 7e-5 弧度，作为切线的角度权重足够
+    inline float fast_acos(float x)
+    {
+        float ax = std::min(std::abs(x), 1.f);
+        float r = std::sqrt(1.f - ax) * (1.5707288f + ax * (-0.2121144f + ax * (0.0742610f - 0.0187293f * ax)));
+        return x < 0.f ? 3.14159265f - r : r;
+    }
+
+    // OBJ 的下标从 1 开始，负数表示相对当前已读到的元素倒数；越界时返回 -1
+    inline int resolve_index(int index, size_t count)
+    {
+        int resolved = index > 0 ? index - 1 : static_cast<int>(count) + index;
+        return index != 0 && resolved >= 0 && static_cast<size_t>(resolved) < count ? resolved : -1;
+    }
+
+    // 大于这个大小的文件才创建线程并行解析
+    constexpr size_t parallel_min_bytes = 4 << 20;
+    // 每块至少这么多字节，避免小文件被切得过碎
+    constexpr size_t min_chunk_bytes = 64 << 10;
+    constexpr uint32_t no_vertex = std::numeric_limits<uint32_t>::max();
+
+    // 并行处理时把工作切成的份数：每个线程几份，便于任务窃取时负载均衡；只有一个线程时不切分
+    inline size_t part_count(const JobSystem &jobs) { return jobs.thread_count() > 1 ? jobs.thread_count() * 4 : 1; }
+
+    // 把 [0, count) 均分成 parts 块，并行调用 body(block, begin, end)
+    template <class F>
+    void for_each_block(JobSystem &jobs, size_t count, size_t parts, const F &body)
+    {
+        const size_t block_size = (count + parts - 1) / parts;
+        jobs.parallel_for(0, parts, 1, [&](size_t first, size_t last)
+        {
+            for (size_t b = first; b < last; ++b)
+                body(b, std::min(count, b * block_size), std::min(count, (b + 1) * block_size));
+        });
+    }
+
+    // 并行的前缀和：values[i] 变为 values[0, i) 之和，返回全部之和
+    uint32_t exclusive_scan(JobSystem &jobs, std::vector<uint32_t> &values)
+    {
+        const size_t parts = part_count(jobs);
+        std::vector<uint32_t> block_sums(parts);
+        for_each_block(jobs, values.size(), parts, [&](size_t block, size_t begin, size_t end)
+        {
+            block_sums[block] = std::accumulate(values.begin() + begin, values.begin() + end, 0u);
+        });
+        const uint32_t total = std::accumulate(block_sums.begin(), block_sums.end(), 0u);
+        std::exclusive_scan(block_sums.begin(), block_sums.end(), block_sums.begin(), 0u);
+        for_each_block(jobs, values.size(), parts, [&](size_t block, size_t begin, size_t end)
         {
-            iss >> trash >> trash;
-            Vec3f nor;
-            for (int i = 0; i < 3; i++) {
-                iss >> nor.raw[i];
+            std::exclusive_scan(values.begin() + begin, values.begin() + end, values.begin() + begin, block_sums[block]);
+        });
+        return total;
+    }
+
+    // 把 [0, count) 中的元素按 key(i) 所在的区间分桶，桶内保持原来的先后顺序
+    // 之后每个 key 区间由一个线程独占处理，按 key 累加或查找时不需要加锁，处理顺序也与串行逐个处理时相同
+    struct RangeBuckets
+    {
+        size_t range_size = 1;        // 每个区间包含的 key 个数
+        std::vector<size_t> offsets;  // 第 r 个区间的元素是 item(offsets[r]) ~ item(offsets[r + 1] - 1)
+        std::vector<uint32_t> items;  // 元素下标；只有一个区间时为空，元素就是 [0, count) 本身，省去分桶
+
+        size_t range_count() const { return offsets.size() - 1; }
+        uint32_t item(size_t i) const { return items.empty() ? static_cast<uint32_t>(i) : items[i]; }
+    };
+
+    template <class Key>
+    RangeBuckets bucket_by_range(JobSystem &jobs, size_t count, size_t key_count, const Key &key)
+    {
+        const size_t parts = part_count(jobs);
+        RangeBuckets buckets;
+        buckets.range_size = std::max<size_t>(1, (key_count + parts - 1) / parts);
+        const size_t ranges = std::max<size_t>(1, (key_count + buckets.range_size - 1) / buckets.range_size);
+        if (ranges == 1)
+        {
+            buckets.offsets = {0, count};
+            return buckets;
+        }
+
+        // 每块元素落在每个区间的个数，前缀和按区间优先、块次之，同一区间内前面块的元素排在前面
+        std::vector<size_t> cursors(parts * ranges, 0);
+        for_each_block(jobs, count, parts, [&](size_t block, size_t begin, size_t end)
+        {
+            size_t *histogram = &cursors[block * ranges];
+            for (size_t i = begin; i < end; ++i)
+                ++histogram[key(i) / buckets.range_size];
+        });
+        buckets.offsets.resize(ranges + 1);
+        size_t sum = 0;
+        for (size_t r = 0; r < ranges; ++r)
+        {
+            buckets.offsets[r] = sum;
+            for (size_t block = 0; block < parts; ++block)
+                sum += std::exchange(cursors[block * ranges + r], sum);
+        }
+        buckets.offsets[ranges] = sum;
+
+        buckets.items.resize(count);
+        for_each_block(jobs, count, parts, [&](size_t block, size_t begin, size_t end)
+        {
+            size_t *cursor = &cursors[block * ranges];
+            for (size_t i = begin; i < end; ++i)
+                buckets.items[cursor[key(i) / buckets.range_size]++] = static_cast<uint32_t>(i);
+        });
+        return buckets;
+    }
+
+    // 各类元素的个数
+    struct ElementCounts
+    {
+        size_t vertices = 0, tex_coords = 0, normals = 0, faces = 0, corners = 0, triangles = 0;
+
+        ElementCounts &operator+=(const ElementCounts &other)
+        {
+            vertices += other.vertices;
+            tex_coords += other.tex_coords;
+            normals += other.normals;
+            faces += other.faces;
+            corners += other.corners;
+            triangles += other.triangles;
+            return *this;
+        }
+    };
+
+    // 按行对齐的一块文件内容：计数之后做前缀和得到块内元素在全局数组中的起始位置，
+    // 各块就能独立解析并直接写到全局数组中，负数（相对）下标也能在块内换算成全局下标
+    struct Chunk
+    {
+        const char *begin = nullptr, *end = nullptr;
+        ElementCounts count{};       // 块内的元素个数
+        ElementCounts base{};        // 之前所有块的元素个数
+        const char *error = nullptr; // 解析失败的元素类型
+    };
+
+    // 一个面顶点的位置/纹理坐标/法线全局下标，-1 表示面中没有给出
+    struct Corner
+    {
+        int v, vt, vn;
+    };
+
+    // 解析结果写入的全局数组
+    struct ParseTarget
+    {
+        Vec3f *vertices;
+        Vec2f *tex_coords;
+        Vec3f *normals;
+        Corner *corners;
+        uint32_t *indices; // 三角形的三个面顶点在 corners 中的下标，去重后再换成顶点下标
+    };
+
+    // 切成大致等长的块，每块在换行符之后结束
+    std::vector<Chunk> split_chunks(const char *begin, const char *end, size_t parts)
+    {
+        parts = std::clamp<size_t>(static_cast<size_t>(end - begin) / min_chunk_bytes, 1, parts);
+        std::vector<Chunk> chunks;
+        chunks.reserve(parts);
+        const char *chunk_begin = begin;
+        for (size_t i = 1; i <= parts && chunk_begin < end; ++i)
+        {
+            const char *chunk_end = i == parts ? end : std::max(chunk_begin, begin + (end - begin) * i / parts);
+            if (chunk_end < end)
+                chunk_end = std::min(end, find_line_end(chunk_end, end) + 1);
+            chunks.push_back({chunk_begin, chunk_end});
+            chunk_begin = chunk_end;
+        }
+        return chunks;
+    }
+
+    void count_chunk(Chunk &chunk)
+    {
+        for (const char *line = chunk.begin; line < chunk.end;)
+        {
+            const char *line_end = find_line_end(line, chunk.end);
+            const char *p = line;
+            switch (classify(p, line_end))
+            {
+            case LineType::Vertex: ++chunk.count.vertices; break;
+            case LineType::TexCoord: ++chunk.count.tex_coords; break;
+            case LineType::Normal: ++chunk.count.normals; break;
+            case LineType::Face:
+            {
+                size_t corners = count_tokens(p, line_end);
+                chunk.count.corners += corners;
+                chunk.count.triangles += corners >= 3 ? corners - 2 : 0;
+                ++chunk.count.faces;
+                break;
             }
+            default: break;
+            }
+            line = line_end + 1;
+        }
+    }
+
+    bool parse_chunk(Chunk &chunk, const ParseTarget &target)
+    {
+        ElementCounts read = chunk.base; // 到当前行为止读到的元素个数（全局）
+        for (const char *line = chunk.begin; line < chunk.end;)
+        {
+            const char *line_end = find_line_end(line, chunk.end);
+            const char *p = line;
+            line = line_end + 1;
+            switch (classify(p, line_end))
+            {
+            case LineType::Vertex: // 顶点
+                if (!parse_floats(p, line_end, target.vertices[read.vertices++]))
+                    chunk.error = "vertex";
+                break;
+            case LineType::TexCoord: // 纹理坐标，只取前两个分量
+                if (!parse_floats(p, line_end, target.tex_coords[read.tex_coords++]))
+                    chunk.error = "texture coordinate";
+                break;
+            case LineType::Normal: // 法向量
+                if (!parse_floats(p, line_end, target.normals[read.normals++]))
+                    chunk.error = "normal";
+                break;
+            case LineType::Face: // 面：v、v/vt、v//vn、v/vt/vn
+            {
+                const size_t first = read.corners;
+                for (p = skip_blanks(p, line_end); p < line_end; p = skip_blanks(p, line_end))
+                {
+                    int idx = 0, tex_idx = 0, n_idx = 0;
+                    bool ok = parse_number(p, line_end, idx);
+                    if (ok && p < line_end && *p == '/')
+                    {
+                        ++p;
+                        if (p < line_end && *p != '/')
+                            ok = parse_number(p, line_end, tex_idx);
+                        if (ok && p < line_end && *p == '/')
+                        {
+                            ++p;
+                            ok = parse_number(p, line_end, n_idx);
+                        }
+                    }
+                    Corner corner{resolve_index(idx, read.vertices), tex_idx ? resolve_index(tex_idx, read.tex_coords) : -1,
+                                  n_idx ? resolve_index(n_idx, read.normals) : -1};
+                    if (!ok || (p < line_end && !is_blank(*p)) || corner.v < 0 || (tex_idx && corner.vt < 0) || (n_idx && corner.vn < 0))
+                    {
+                        chunk.error = "face";
+                        return false;
+                    }
+                    target.corners[read.corners++] = corner;
+                }
+
+                // 多边形面按扇形拆成三角形
+                for (size_t i = first + 1; i + 1 < read.corners; ++i)
+                {
+                    uint32_t *triangle = &target.indices[read.triangles++ * 3];
+                    triangle[0] = static_cast<uint32_t>(first);
+                    triangle[1] = static_cast<uint32_t>(i);
+                    triangle[2] = static_cast<uint32_t>(i + 1);
+                }
+                break;
+            }
+            default:
+                break;
+            }
+            if (chunk.error)
+                return false;
+        }
+        return true;
+    }
+}
+
+bool objl::Loader::Load(const std::string &path, bool use_cache)
+{
+    if (path.size() < 4 || path.compare(path.size() - 4, 4, ".obj") != 0)
+    {
+        LOGE("the file is not an .obj file");
+        return false;
+    }
+
+    // 缓存与源文件一致时直接映射缓存，不再解析文本
+    const std::string cache_path = path + ".meshcache";
+    if (use_cache && read_mesh_cache(cache_path, path, LoadedMesh))
+    {
+        LOGI("model loaded from cache: {} (unique vert# {} triangle# {})", cache_path, LoadedMesh.vertex_count(), LoadedMesh.triangle_count());
+        return true;
+    }
+
+    MeshData data;
+    if (!Parse(path, data))
+        return false;
+    LoadedMesh = Mesh(std::move(data));
+    if (use_cache)
+        write_mesh_cache(cache_path, path, LoadedMesh); // 写入失败只影响下次的加载速度
+    return true;
+}
+
+bool objl::Loader::Parse(const std::string &path, MeshData &data)
+{
+    // 整个文件映射进内存，之后两遍扫描都直接读映射的字节
+    MappedFile file(path);
+    if (!file.is_open())
+    {
+        LOGE("Failed to open file: {}", path);
+        return false;
+    }
+    const char *const begin = file.data();
+    const char *const end = begin + file.size();
+
+    // 调用线程也参与计算，只用一个线程时不创建后台线程
+    const unsigned threads = parse_threads ? parse_threads
+                             : file.size() >= parallel_min_bytes ? std::max(1u, std::thread::hardware_concurrency())
+                                                                 : 1u;
+    JobSystem jobs{threads - 1};
+    const size_t parts = part_count(jobs);
+    std::vector<Chunk> chunks = split_chunks(begin, end, parts);
+
+    // 第一遍只数各类元素的个数，前缀和之后每块知道自己的元素写到全局数组的什么位置，每个数组只分配一次
+    jobs.parallel_for(0, chunks.size(), 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+            count_chunk(chunks[i]);
+    });
+    ElementCounts total;
+    for (Chunk &chunk : chunks)
+    {
+        chunk.base = total;
+        total += chunk.count;
+    }
 
-            _Normals.push_back(nor);
+    // 第二遍各块并行解析；文件中原始的位置、纹理坐标和法线只在生成索引网格时使用，解析结束即释放
+    std::vector<Vec3f> raw_positions(total.vertices);
+    std::vector<Vec2f> raw_tex_coords(total.tex_coords);
+    std::vector<Vec3f> raw_normals(total.normals);
+    std::vector<Corner> corners(total.corners);
+    data = MeshData{};
+    data.indices.resize(total.triangles * 3);
+    const ParseTarget target{raw_positions.data(), raw_tex_coords.data(), raw_normals.data(), corners.data(), data.indices.data()};
+    jobs.parallel_for(0, chunks.size(), 1, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+            parse_chunk(chunks[i], target);
+    });
+    for (const Chunk &chunk : chunks)
+        if (chunk.error)
+        {
+            LOGE("Invalid {} in {}", chunk.error, path);
+            return false;
         }
-        else if (!line.compare(0, 2, "f ")) // 面
+
+    // 面顶点 (v, vt, vn) 去重：面顶点按位置下标所在的区间分桶，每个区间由一个线程独占，
+    // 同一位置的顶点串成链表，查找时只比较纹理坐标和法线下标，不需要哈希表
+    struct VertexRef
+    {
+        int tex_idx, n_idx;    // -1 表示面中没有给出
+        uint32_t next;         // 同一位置的下一个顶点
+        uint32_t first_corner; // 第一次出现的面顶点
+        uint32_t vertex;       // 最终的顶点下标
+    };
+    const RangeBuckets corners_by_position = bucket_by_range(jobs, corners.size(), raw_positions.size(), [&](size_t c) { return corners[c].v; });
+    const size_t position_ranges = corners_by_position.range_count();
+    std::vector<std::vector<VertexRef>> vertex_refs(position_ranges);
+    std::vector<uint32_t> first_vertex(raw_positions.size(), no_vertex);
+    std::vector<uint32_t> corner_ref(corners.size());   // 面顶点在所在区间 vertex_refs 中的序号
+    std::vector<uint32_t> first_use(corners.size(), 0);  // 面顶点是否第一次出现，前缀和之后就是顶点下标
+    jobs.parallel_for(0, position_ranges, 1, [&](size_t first, size_t last)
+    {
+        for (size_t r = first; r < last; ++r)
         {
-            std::vector<Vertex> Vertices;
-            Vertex v;
-            int idx, tex_idx, n_idx;
-            iss >> trash;
-            while (iss >> idx >> trash >> tex_idx >> trash >> n_idx)
+            auto &refs = vertex_refs[r];
+            for (size_t i = corners_by_position.offsets[r]; i < corners_by_position.offsets[r + 1]; ++i)
             {
-                idx--;     // .obj 文件中的索引从1开始
-                tex_idx--; // .obj 文件中的索引从1开始
-                n_idx--;   // .obj 文件中的索引从1开始
-                v.Position = _Vertices[idx];
-                v.TextureCoordinate = _Texture[tex_idx];
-                v.Normal = _Normals[n_idx];
-                Vertices.push_back(v);
+                const uint32_t c = corners_by_position.item(i);
+                const Corner &corner = corners[c];
+                uint32_t ref = first_vertex[corner.v];
+                while (ref != no_vertex && (refs[ref].tex_idx != corner.vt || refs[ref].n_idx != corner.vn))
+                    ref = refs[ref].next;
+                if (ref == no_vertex)
+                {
+                    ref = static_cast<uint32_t>(refs.size());
+                    refs.push_back({corner.vt, corner.vn, first_vertex[corner.v], c, 0});
+                    first_vertex[corner.v] = ref;
+                    first_use[c] = 1;
+                }
+                corner_ref[c] = ref;
             }
+        }
+    });
 
-            LoadedMeshes.push_back(Mesh(Vertices));
+    // 顶点按第一次出现的先后编号，与逐个面串行去重的结果相同
+    const uint32_t vertex_count = exclusive_scan(jobs, first_use);
+    data.positions.resize(vertex_count);
+    data.normals.resize(vertex_count);
+    data.tex_coords.resize(vertex_count);
+    data.colors.resize(vertex_count);
+    std::vector<uint8_t> generated_normal(vertex_count, 0); // 面中没有给出法线的顶点
+    const Vec3f vertex_color = Vec3f{148.f, 121.f, 92.f} / 255.f;
+    jobs.parallel_for(0, position_ranges, 1, [&](size_t first, size_t last)
+    {
+        for (size_t r = first; r < last; ++r)
+            for (VertexRef &ref : vertex_refs[r])
+            {
+                const uint32_t v = ref.vertex = first_use[ref.first_corner];
+                data.positions[v] = raw_positions[corners[ref.first_corner].v];
+                data.normals[v] = ref.n_idx >= 0 ? raw_normals[ref.n_idx] : Vec3f{0.f, 0.f, 0.f};
+                data.tex_coords[v] = ref.tex_idx >= 0 ? raw_tex_coords[ref.tex_idx] : Vec2f{0.f, 0.f};
+                data.colors[v] = vertex_color;
+                generated_normal[v] = ref.n_idx < 0;
+            }
+    });
+    // 三角形中的面顶点下标换成顶点下标
+    for_each_block(jobs, data.indices.size(), parts, [&](size_t, size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t c = data.indices[i];
+            data.indices[i] = vertex_refs[corners[c].v / corners_by_position.range_size][corner_ref[c]].vertex;
         }
+    });
+
+    // 面中没有给出法线的顶点，用相邻三角形按面积加权的法线；按顶点区间分桶后并行累加，累加顺序与逐个三角形累加相同
+    if (std::find(generated_normal.begin(), generated_normal.end(), 1) != generated_normal.end())
+    {
+        const RangeBuckets corners_by_vertex = bucket_by_range(jobs, data.indices.size(), vertex_count, [&](size_t i) { return data.indices[i]; });
+        jobs.parallel_for(0, corners_by_vertex.range_count(), 1, [&](size_t first, size_t last)
+        {
+            const auto &pos = data.positions;
+            for (size_t r = first; r < last; ++r)
+            {
+                size_t face = std::numeric_limits<size_t>::max(); // 同一个三角形的几个顶点通常挨在一起，面法线只算一次
+                Vec3f face_normal;
+                for (size_t i = corners_by_vertex.offsets[r]; i < corners_by_vertex.offsets[r + 1]; ++i)
+                {
+                    const size_t corner = corners_by_vertex.item(i);
+                    const uint32_t v = data.indices[corner];
+                    if (!generated_normal[v])
+                        continue;
+                    if (corner / 3 != face)
+                    {
+                        face = corner / 3;
+                        const uint32_t *tri = &data.indices[face * 3];
+                        face_normal = (pos[tri[1]] - pos[tri[0]]) ^ (pos[tri[2]] - pos[tri[0]]);
+                    }
+                    data.normals[v] += face_normal;
+                }
+                const size_t range_end = std::min<size_t>(vertex_count, (r + 1) * corners_by_vertex.range_size);
+                for (size_t v = r * corners_by_vertex.range_size; v < range_end; ++v)
+                    if (generated_normal[v])
+                        data.normals[v].normalize();
+            }
+        });
     }
 
-    LOGI("model vert# {} face# {} tex_coord# {} normals# {}",
-         static_cast<int>(_Vertices.size()),
-         static_cast<int>(LoadedMeshes.size()),
-         static_cast<int>(_Texture.size()),
-         static_cast<int>(_Normals.size()));
-    
+    compute_tangents(data, jobs);
+
+    LOGI("model vert# {} face# {} tex_coord# {} normals# {} unique vert# {}",
+         static_cast<int>(total.vertices),
+         static_cast<int>(total.faces),
+         static_cast<int>(total.tex_coords),
+         static_cast<int>(total.normals),
+         static_cast<int>(data.vertex_count()));
+
     return true;
 }
 
-std::vector<Triangle> objl::LoadTriangleList(const Loader &model)
+void objl::compute_tangents(MeshData &mesh, JobSystem &jobs)
 {
-    std::vector<Triangle> TriangleList;
-    for (const auto &mesh : model.LoadedMeshes)
+    const size_t parts = part_count(jobs);
+    const size_t triangle_count = mesh.triangle_count();
+
+    // 每个三角形由位置和纹理坐标解出的切线与副切线方向，纹理坐标退化的三角形方向记为 0，不贡献切线
+    std::vector<Vec3f> face_tangents(triangle_count);
+    std::vector<int8_t> face_signs(triangle_count, 0);
+    for_each_block(jobs, triangle_count, parts, [&](size_t, size_t begin, size_t end)
     {
-        for (int i = 0; i < mesh.Vertices.size(); i += 3)
+        for (size_t t = begin; t < end; ++t)
         {
-            Triangle t;
-            for (int j = 0; j < 3; j++)
+            const uint32_t *face = &mesh.indices[t * 3];
+            const Vec3f p[3] = {mesh.positions[face[0]], mesh.positions[face[1]], mesh.positions[face[2]]};
+            const Vec2f uv[3] = {mesh.tex_coords[face[0]], mesh.tex_coords[face[1]], mesh.tex_coords[face[2]]};
+
+            // 解 e1 = du1 * T + dv1 * B，e2 = du2 * T + dv2 * B
+            Vec3f e1 = p[1] - p[0], e2 = p[2] - p[0];
+            float du1 = uv[1].x - uv[0].x, dv1 = uv[1].y - uv[0].y;
+            float du2 = uv[2].x - uv[0].x, dv2 = uv[2].y - uv[0].y;
+            float det = du1 * dv2 - du2 * dv1;
+            if (std::abs(det) < 1e-12f)
+                continue;
+            Vec3f tangent = (e1 * dv2 - e2 * dv1) / det;
+            Vec3f bitangent = (e2 * du1 - e1 * du2) / det;
+            face_tangents[t] = tangent;
+            face_signs[t] = ((e1 ^ e2) ^ tangent) * bitangent < 0.f ? -1 : 1;
+        }
+    });
+
+    // 按三角形的顺序确定每个顶点的副切线方向，方向相反的三角形改用拆出的顶点；只有整数运算，串行完成
+    std::vector<int8_t> handedness(mesh.vertex_count(), 0); // 顶点已确定的副切线方向，0 表示尚未确定
+    std::vector<uint32_t> mirrored(mesh.vertex_count(), no_vertex); // 副切线方向相反时拆出的顶点
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        const int8_t sign = face_signs[t];
+        if (sign == 0)
+            continue;
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t &v = mesh.indices[t * 3 + k];
+            if (handedness[v] == 0)
+                handedness[v] = sign;
+            else if (handedness[v] != sign)
             {
-                t.setVertex(j, Vec3f{mesh.Vertices[i + j].Position.x, mesh.Vertices[i + j].Position.y, mesh.Vertices[i + j].Position.z});
-                t.setNormal(j, Vec3f{mesh.Vertices[i + j].Normal.x, mesh.Vertices[i + j].Normal.y, mesh.Vertices[i + j].Normal.z});
-                t.setTexCoord(j, Vec2f{mesh.Vertices[i + j].TextureCoordinate.x, mesh.Vertices[i + j].TextureCoordinate.y});
-                t.setColor(j, {148.f, 121.f, 92.f});
+                if (mirrored[v] == no_vertex)
+                {
+                    mirrored[v] = static_cast<uint32_t>(mesh.vertex_count());
+                    Vec3f position = mesh.positions[v], normal = mesh.normals[v], color = mesh.colors[v];
+                    Vec2f tex_coords = mesh.tex_coords[v];
+                    mesh.positions.push_back(position);
+                    mesh.normals.push_back(normal);
+                    mesh.tex_coords.push_back(tex_coords);
+                    mesh.colors.push_back(color);
+                    handedness.push_back(sign);
+                    mirrored.push_back(v);
+                }
+                v = mirrored[v];
             }
-            TriangleList.emplace_back(t);
         }
     }
-    return TriangleList;
-}
\ No newline at end of file
+
+    // 每个顶点累加所在三角形的切线：投影到顶点法线的切平面，按三角形在该顶点处的角度加权；
+    // 三角形的顶点按顶点区间分桶，每个区间由一个线程独占，累加顺序与逐个三角形累加相同
+    const size_t vertex_count = mesh.vertex_count();
+    const RangeBuckets corners_by_vertex = bucket_by_range(jobs, mesh.indices.size(), vertex_count, [&](size_t i) { return mesh.indices[i]; });
+    std::vector<Vec3f> tangent_sum(vertex_count);
+    mesh.tangents.resize(vertex_count);
+    jobs.parallel_for(0, corners_by_vertex.range_count(), 1, [&](size_t first, size_t last)
+    {
+        for (size_t r = first; r < last; ++r)
+        {
+            for (size_t i = corners_by_vertex.offsets[r]; i < corners_by_vertex.offsets[r + 1]; ++i)
+            {
+                const size_t corner = corners_by_vertex.item(i), t = corner / 3, k = corner % 3;
+                if (face_signs[t] == 0)
+                    continue;
+                const uint32_t *face = &mesh.indices[t * 3];
+                const uint32_t v = face[k];
+                Vec3f n = mesh.normals[v];
+                n.normalize();
+                Vec3f t_proj = face_tangents[t] - n * (n * face_tangents[t]);
+                Vec3f a = mesh.positions[face[(k + 1) % 3]] - mesh.positions[v], b = mesh.positions[face[(k + 2) % 3]] - mesh.positions[v];
+                float len2 = (a * a) * (b * b), t_len2 = t_proj * t_proj;
+                if (len2 == 0.f || t_len2 == 0.f)
+                    continue;
+                float angle = fast_acos((a * b) / std::sqrt(len2));
+                tangent_sum[v] += t_proj * (angle / std::sqrt(t_len2));
+            }
+
+            const size_t range_end = std::min(vertex_count, (r + 1) * corners_by_vertex.range_size);
+            for (size_t v = r * corners_by_vertex.range_size; v < range_end; ++v)
+            {
+                Vec3f n = mesh.normals[v];
+                n.normalize();
+                Vec3f t = tangent_sum[v] - n * (n * tangent_sum[v]);
+                if (t.norm() < 1e-8f)
+                {
+                    // 没有可用的纹理坐标时任取一个与法线垂直的方向
+                    t = std::abs(n.x) < 0.9f ? Vec3f{1.f, 0.f, 0.f} : Vec3f{0.f, 1.f, 0.f};
+                    t = t - n * (n * t);
+                }
+                t.normalize();
+                mesh.tangents[v] = Vec4f{t.x, t.y, t.z, handedness[v] < 0 ? -1.f : 1.f};
+            }
+        }
+    });
+}
@@ -1,39 +1,31 @@
 ﻿#pragma once
-#include <iostream>
-#include <fstream>
-#include <sstream>
+#include <string>
+#include <vector>
+#include "JobSystem.hpp"
 #include "Log.hpp"
-#include "Triangle.h"
+#include "Mesh.hpp"
 
 namespace objl {
-    struct Vertex
-    {
-        Vec3f Position;
-
-        Vec3f Normal;
-
-        Vec2f TextureCoordinate;
-    };
-
-    struct Mesh
-    {
-        Mesh(std::vector<Vertex> &_Vertices) : Vertices(_Vertices) {}
-
-        std::vector<Vertex> Vertices;
-    };
-
     class Loader
     {
     private:
-        std::vector<Vec3f> _Vertices;
-        std::vector<Vec2f> _Texture;
-        std::vector<Vec3f> _Normals;
+        // 解析 .obj 文件：文件整体映射进内存，按行切成若干块并行解析；
+        // 第一遍统计每块中各类元素的个数并一次性分配，第二遍各块解析后直接写到全局数组中，再去重生成索引网格
+        bool Parse(const std::string &path, MeshData &data);
 
     public:
-        bool Load(const std::string &);
+        // 读取 .obj 文件；use_cache 时优先映射同目录下的二进制缓存（<path>.meshcache），缓存不存在或已过期时解析后重新写入
+        bool Load(const std::string &path, bool use_cache = true);
+
+        Mesh LoadedMesh; // 位置/纹理/法线下标完全相同的面顶点合并为一个顶点
 
-        std::vector<Mesh> LoadedMeshes;
+        // 解析使用的线程数，0 表示按文件大小决定：大文件使用全部核心，小文件只在当前线程上解析
+        unsigned parse_threads = 0;
     };
 
-    std::vector<Triangle> LoadTriangleList(const Loader &loader);
+    // 由位置和纹理坐标生成每个顶点的切线与副切线方向（MikkTSpace 的做法）：
+    // 每个三角形的切线投影到顶点法线的切平面上，按顶点处的角度加权累加，再与法线正交化；
+    // 镜像 UV 两侧的三角形副切线方向相反，共用的顶点会被拆成两个，避免切线互相抵消
+    // 逐三角形的切线和逐顶点的累加在 jobs 上并行完成，结果与串行计算逐位一致
+    void compute_tangents(MeshData &mesh, JobSystem &jobs);
 }
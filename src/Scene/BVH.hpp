@@ -0,0 +1,147 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include "Bounds.hpp"
+
+// 物体级 BVH：叶子最多保存 max_leaf_objects 个物体，内部节点的包围盒是两个子节点的并集
+// build 按物体包围盒中心沿最长轴取中位数二分，树高为 O(log n)；
+// 物体移动后 refit 只沿它所在的叶子到根的路径更新包围盒，不改变树的结构
+class ObjectBVH
+{
+public:
+    // bounds[i] 为第 i 个物体的包围盒；空包围盒表示物体没有包围盒，这样的物体不参与剔除，总是被访问
+    void build(std::vector<AABB> bounds)
+    {
+        object_bounds = std::move(bounds);
+        rebuild();
+    }
+
+    void refit(size_t object, const AABB &bounds)
+    {
+        // 有无包围盒发生变化时物体要进出树，直接重建
+        if (bounds.empty() != object_bounds[object].empty())
+        {
+            object_bounds[object] = bounds;
+            rebuild();
+            return;
+        }
+        object_bounds[object] = bounds;
+        if (bounds.empty())
+            return;
+
+        uint32_t index = leaf_of[object];
+        AABB box;
+        for (uint32_t i = nodes[index].first; i < nodes[index].first + nodes[index].count; ++i)
+            box.expand(object_bounds[order[i]]);
+        nodes[index].box = box;
+        while (nodes[index].parent != no_node)
+        {
+            index = nodes[index].parent;
+            Node &node = nodes[index];
+            node.box = nodes[node.first].box;
+            node.box.expand(nodes[node.first + 1].box);
+        }
+    }
+
+    // 访问所有与视锥体相交的物体，visit(物体下标)；整棵在视锥体外的子树直接跳过，不会碰到其中的物体。
+    // 每个内部节点先进入离相机较近的子节点，可见物体大致按由近到远的顺序访问
+    template <class Visit>
+    void traverse(const Frustum &frustum, Visit &&visit) const
+    {
+        for (uint32_t object : unbounded)
+            visit(static_cast<size_t>(object));
+        if (nodes.empty())
+            return;
+
+        // 中位数二分的树高不超过 log2(n) + 1，栈中最多同时有树高个节点
+        uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node &node = nodes[stack[--top]];
+            if (!frustum.intersects(node.box))
+                continue;
+            if (node.count > 0)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; ++i)
+                    if (node.count == 1 || frustum.intersects(object_bounds[order[i]]))
+                        visit(static_cast<size_t>(order[i]));
+                continue;
+            }
+            // 后压栈的先出栈
+            bool left_first = frustum.distance(nodes[node.first].box.center()) <= frustum.distance(nodes[node.first + 1].box.center());
+            stack[top++] = left_first ? node.first + 1 : node.first;
+            stack[top++] = left_first ? node.first : node.first + 1;
+        }
+    }
+
+    size_t node_count() const { return nodes.size(); }
+
+private:
+    static constexpr uint32_t max_leaf_objects = 4;
+    static constexpr uint32_t no_node = ~0u;
+
+    struct Node
+    {
+        AABB box;
+        uint32_t first;  // 叶子：物体在 order 中的起始位置；内部节点：左子节点下标，右子节点紧随其后
+        uint32_t count;  // 叶子中的物体数，内部节点为 0
+        uint32_t parent; // 根节点为 no_node
+    };
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;     // 按叶子顺序排列的物体下标
+    std::vector<uint32_t> leaf_of;   // 每个物体所在的叶子
+    std::vector<uint32_t> unbounded; // 没有包围盒的物体
+    std::vector<AABB> object_bounds;
+
+    void rebuild()
+    {
+        nodes.clear();
+        order.clear();
+        unbounded.clear();
+        leaf_of.assign(object_bounds.size(), no_node);
+        for (uint32_t i = 0; i < object_bounds.size(); ++i)
+            (object_bounds[i].empty() ? unbounded : order).push_back(i);
+        if (order.empty())
+            return;
+
+        nodes.reserve(order.size() / max_leaf_objects * 2 + 1);
+        nodes.push_back({AABB(), 0, 0, no_node});
+        build_node(0, 0, static_cast<uint32_t>(order.size()));
+    }
+
+    void build_node(uint32_t index, uint32_t first, uint32_t count)
+    {
+        AABB box, centers;
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            box.expand(object_bounds[order[i]]);
+            centers.expand(object_bounds[order[i]].center());
+        }
+        nodes[index].box = box;
+        if (count <= max_leaf_objects)
+        {
+            nodes[index].first = first;
+            nodes[index].count = count;
+            for (uint32_t i = first; i < first + count; ++i)
+                leaf_of[order[i]] = index;
+            return;
+        }
+
+        // 沿包围盒中心分布最广的轴，按中心坐标的中位数把物体分成两半
+        const Vec3f extent = centers.max - centers.min;
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        const uint32_t mid = first + count / 2;
+        std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count, [&](uint32_t a, uint32_t b)
+                         { return object_bounds[a].center().raw[axis] < object_bounds[b].center().raw[axis]; });
+
+        const uint32_t left = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({AABB(), 0, 0, index});
+        nodes.push_back({AABB(), 0, 0, index});
+        nodes[index].first = left;
+        nodes[index].count = 0;
+        build_node(left, first, mid - first);
+        build_node(left + 1, mid, first + count - mid);
+    }
+};
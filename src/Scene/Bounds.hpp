@@ -0,0 +1,95 @@
+﻿#pragma once
+#include <algorithm>
+#include <array>
+#include <limits>
+#include "Vec.hpp"
+
+// 轴对齐包围盒；默认构造为空盒（min > max），expand 之后才有效
+struct AABB
+{
+    Vec3f min{std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+    Vec3f max{-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+
+    AABB() = default;
+    AABB(const Vec3f &lo, const Vec3f &hi) : min(lo), max(hi) {}
+
+    bool empty() const { return min.x > max.x; }
+    Vec3f center() const { return (min + max) * 0.5f; }
+
+    void expand(const Vec3f &p)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            min.raw[i] = std::min(min.raw[i], p.raw[i]);
+            max.raw[i] = std::max(max.raw[i], p.raw[i]);
+        }
+    }
+    void expand(const AABB &box)
+    {
+        if (box.empty())
+            return;
+        expand(box.min);
+        expand(box.max);
+    }
+
+    // 经仿射变换 m 之后的包围盒：每个输出分量把各列贡献的较小值、较大值分别相加（Arvo 的方法），不用逐个变换 8 个角点
+    AABB transformed(const Matrix4f &m) const
+    {
+        if (empty())
+            return *this;
+        AABB box;
+        for (int i = 0; i < 3; ++i)
+        {
+            box.min.raw[i] = box.max.raw[i] = m.m[i][3];
+            for (int j = 0; j < 3; ++j)
+            {
+                float a = m.m[i][j] * min.raw[j], b = m.m[i][j] * max.raw[j];
+                box.min.raw[i] += std::min(a, b);
+                box.max.raw[i] += std::max(a, b);
+            }
+        }
+        return box;
+    }
+};
+
+// 视锥体：由把包围盒所在空间变换到齐次裁剪空间的矩阵 clip 直接求出六个平面（Gribb-Hartmann），
+// 条件与光栅化器的裁剪一致：-w <= x <= w，-w <= y <= w，z_near <= w <= z_far
+struct Frustum
+{
+    using plane = std::array<float, 4>; // a * x + b * y + c * z + d >= 0 为内侧
+    std::array<plane, 6> planes;
+    plane depth; // 裁剪空间的 w，即视空间中到相机的距离
+
+    Frustum(const Matrix4f &clip, float z_near, float z_far)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            depth[k] = clip.m[3][k];
+            planes[0][k] = depth[k] + clip.m[0][k];
+            planes[1][k] = depth[k] - clip.m[0][k];
+            planes[2][k] = depth[k] + clip.m[1][k];
+            planes[3][k] = depth[k] - clip.m[1][k];
+            planes[4][k] = depth[k];
+            planes[5][k] = -depth[k];
+        }
+        planes[4][3] -= z_near;
+        planes[5][3] += z_far;
+    }
+
+    // 保守测试：只有包围盒完全位于某个平面外侧时才返回 false
+    bool intersects(const AABB &box) const
+    {
+        for (const plane &p : planes)
+        {
+            // 包围盒沿平面法线方向最远的角点也在外侧，则整个包围盒都在外侧
+            float d = p[3];
+            for (int i = 0; i < 3; ++i)
+                d += p[i] * (p[i] >= 0.f ? box.max.raw[i] : box.min.raw[i]);
+            if (d < 0.f)
+                return false;
+        }
+        return true;
+    }
+
+    float distance(const Vec3f &p) const { return depth[0] * p.x + depth[1] * p.y + depth[2] * p.z + depth[3]; }
+};
@@ -26,8 +26,8 @@ namespace Materials
         material.Kd = Vec3f{0.9f, 0.7f, 0.6f};    // 漫反射，调整为肉色
         material.Ks = Vec3f{0.1f, 0.1f, 0.1f};    // 镜面反射，降低以模拟皮肤的粗糙表面
         material.specularExponent = 10.f;         // 高光指数，降低以使高光区域更加柔和
-        material.map_Kd = Texture(texturePath);            // 漫反射贴图路径
-        material.map_bump = Texture(texturePath);  // 凹凸贴图路径
+        material.map_Kd = TextureCache::get_instance().load(texturePath);   // 漫反射贴图路径
+        material.map_bump = TextureCache::get_instance().load(texturePath); // 凹凸贴图路径（与漫反射贴图共用同一份纹理）
         return material;
     }
 
@@ -39,7 +39,7 @@ namespace Materials
         material.Kd = Vec3f{0.8f, 0.8f, 0.8f};
         material.Ks = Vec3f{0.7937f, 0.7937f, 0.7937f};
         material.specularExponent = 150.f;
-        material.map_Kd = Texture(texturePath); // 漫反射贴图路径
+        material.map_Kd = TextureCache::get_instance().load(texturePath); // 漫反射贴图路径
         return material;
     }
 
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+#include "Vec.hpp"
+
+// 可修改的网格数据：加载、生成切线等构建阶段使用，构建完成后交给 Mesh
+struct MeshData
+{
+    std::vector<Vec3f> positions;
+    std::vector<Vec3f> normals;
+    std::vector<Vec2f> tex_coords;
+    std::vector<Vec3f> colors; // 0~1
+    std::vector<Vec4f> tangents; // xyz 为与法线正交的单位切线（沿 u 增大的方向），w 为副切线方向 ±1：B = w * (N × T)
+    std::vector<uint32_t> indices;
+
+    size_t vertex_count() const { return positions.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+};
+
+// 索引网格：去重后的顶点属性按属性分开连续存放（SoA），再加上每三个一组的顶点下标
+// 共享顶点每帧只需变换一次，顶点处理阶段只顺序读取需要的属性流，三角形在顶点处理之后按下标装配
+// 属性流是只读视图，数据由 storage 持有：既可以是解析 OBJ 得到的 MeshData，也可以是内存映射的二进制网格缓存，
+// 渲染器直接读取映射的内存，不做解析和拷贝；拷贝 Mesh 只复制视图和引用计数
+struct Mesh
+{
+    std::span<const Vec3f> positions;
+    std::span<const Vec3f> normals;
+    std::span<const Vec2f> tex_coords;
+    std::span<const Vec3f> colors;
+    std::span<const Vec4f> tangents;
+    std::span<const uint32_t> indices;
+    Vec3f bounds_min, bounds_max; // 模型空间的包围盒
+
+    std::shared_ptr<const void> storage;
+
+    Mesh() = default;
+    explicit Mesh(MeshData data)
+    {
+        auto owned = std::make_shared<const MeshData>(std::move(data));
+        positions = owned->positions;
+        normals = owned->normals;
+        tex_coords = owned->tex_coords;
+        colors = owned->colors;
+        tangents = owned->tangents;
+        indices = owned->indices;
+        storage = std::move(owned);
+
+        if (!positions.empty())
+        {
+            bounds_min = bounds_max = positions[0];
+            for (const Vec3f &p : positions)
+                for (int i = 0; i < 3; ++i)
+                {
+                    bounds_min.raw[i] = std::min(bounds_min.raw[i], p.raw[i]);
+                    bounds_max.raw[i] = std::max(bounds_max.raw[i], p.raw[i]);
+                }
+        }
+    }
+
+    size_t vertex_count() const { return positions.size(); }
+    size_t triangle_count() const { return indices.size() / 3; }
+};
@@ -1,6 +1,7 @@
 ﻿#pragma once
-#include "Triangle.h"
-#include "Texture.h"
+#include "Bounds.hpp"
+#include "Mesh.hpp"
+#include "TextureCache.h"
 
 enum MaterialType
 {
@@ -26,13 +27,89 @@ struct Material
 
     // 纹理贴图
     std::string map_Ka;   // 环境光贴图
-    std::optional<Texture> map_Kd;       // 漫反射贴图
+    std::shared_ptr<const Texture> map_Kd;   // 漫反射贴图（由 TextureCache 共享，拷贝材质只复制句柄）
     std::string map_Ks;   // 镜面反射贴图
     std::string map_Ns;   // 镜面高光贴图
     std::string map_d;    // 透明度贴图
-    std::optional<Texture> map_bump; // 凹凸贴图
+    std::shared_ptr<const Texture> map_bump; // 凹凸贴图
+    std::shared_ptr<const Texture> map_normal; // 切线空间法线贴图
 };
 
+// 由平移、旋转（角度，依次绕 x、y、z 轴）和缩放组合出模型矩阵：先缩放，再旋转，最后平移
+inline Matrix4f model_matrix(const Vec3f &translate, const Vec3f &rotate, const Vec3f &scale)
+{
+    // 将角度转换为弧度
+    float rx = static_cast<float>(rotate.x * MY_PI / 180.f);
+    float ry = static_cast<float>(rotate.y * MY_PI / 180.f);
+    float rz = static_cast<float>(rotate.z * MY_PI / 180.f);
+
+    // 计算三角函数值
+    float cos_x = cos(rx), sin_x = sin(rx);
+    float cos_y = cos(ry), sin_y = sin(ry);
+    float cos_z = cos(rz), sin_z = sin(rz);
+
+    // 计算组合变换矩阵的元素
+    float m11 = cos_y * cos_z * scale.x;
+    float m12 = (sin_x * sin_y * cos_z - cos_x * sin_z) * scale.y;
+    float m13 = (cos_x * sin_y * cos_z + sin_x * sin_z) * scale.z;
+    float m14 = translate.x;
+
+    float m21 = cos_y * sin_z * scale.x;
+    float m22 = (sin_x * sin_y * sin_z + cos_x * cos_z) * scale.y;
+    float m23 = (cos_x * sin_y * sin_z - sin_x * cos_z) * scale.z;
+    float m24 = translate.y;
+
+    float m31 = -sin_y * scale.x;
+    float m32 = sin_x * cos_y * scale.y;
+    float m33 = cos_x * cos_y * scale.z;
+    float m34 = translate.z;
+
+    // // 绕 X 轴旋转
+    // Matrix4f rotate_x{
+    //     1, 0, 0, 0,
+    //     0, cos(rx), -sin(rx), 0,
+    //     0, sin(rx), cos(rx), 0,
+    //     0, 0, 0, 1};
+
+    // // 绕 Y 轴旋转
+    // Matrix4f rotate_y{
+    //     cos(ry), 0, sin(ry), 0,
+    //     0, 1, 0, 0,
+    //     -sin(ry), 0, cos(ry), 0,
+    //     0, 0, 0, 1};
+
+    // // 绕 Z 轴旋转
+    // Matrix4f rotate_z{
+    //     cos(rz), -sin(rz), 0, 0,
+    //     sin(rz), cos(rz), 0, 0,
+    //     0, 0, 1, 0,
+    //     0, 0, 0, 1};
+
+    // // 缩放矩阵
+    // Matrix4f scale_mat{
+    //     scale.x, 0, 0, 0,
+    //     0, scale.y, 0, 0,
+    //     0, 0, scale.z, 0,
+    //     0, 0, 0, 1};
+
+    // // 平移矩阵
+    // Matrix4f translate_mat{
+    //     1, 0, 0, translate.x,
+    //     0, 1, 0, translate.y,
+    //     0, 0, 1, translate.z,
+    //     0, 0, 0, 1};
+
+    // // 组合变换：先缩放，再旋转，最后平移
+    // return translate_mat * rotate_z * rotate_y * rotate_x * scale_mat;
+
+    // 构建最终的组合变换矩阵
+    return Matrix4f{
+        m11, m12, m13, m14,
+        m21, m22, m23, m24,
+        m31, m32, m33, m34,
+        0, 0, 0, 1};
+}
+
 class Object
 {
 public:
@@ -78,20 +155,47 @@ public:
     virtual ~Object() = default;
 
     const Material &getSurfaceProperties() const { return material; }
+    void set_transform(const Vec3f &translate, const Vec3f &rotate, const Vec3f &scale) { transform = model_matrix(translate, rotate, scale); }
+
+    // 模型空间（transform 之前）的包围盒；空包围盒表示没有包围盒，这样的物体不做剔除
+    virtual AABB local_bounds() const { return {}; }
+    // 场景空间（transform 之后）的包围盒
+    AABB get_bounds() const { return local_bounds().transformed(transform); }
 
     Material material;
+    // 物体自己的模型矩阵（默认单位矩阵），绘制时再左乘光栅化器的 set_model
+    // 物体加入场景后再修改 transform 或实例，要调用 Scene::mark_moved 更新它在 BVH 中的包围盒
+    Matrix4f transform;
 };
 
 class MeshTriangle : public Object
 {
 public:
-    // 构造函数，接受三角形列表和 MaterialType
-    MeshTriangle(std::vector<Triangle> &TriangleList, MaterialType type = DIFFUSE_AND_GLOSSY)
-        : Object(type), Triangles(TriangleList) {}
+    // 构造函数，接受索引网格和 MaterialType
+    MeshTriangle(Mesh &mesh, MaterialType type = DIFFUSE_AND_GLOSSY)
+        : Object(type), mesh(mesh) {}
+
+    // 构造函数，接受索引网格和 Material 对象
+    MeshTriangle(Mesh &mesh, const Material &mat)
+        : Object(mat), mesh(mesh) {}
 
-    // 构造函数，接受三角形列表和 Material 对象
-    MeshTriangle(std::vector<Triangle> &TriangleList, const Material &mat)
-        : Object(mat), Triangles(TriangleList) {}
+    // 网格只按引用持有，同一个网格可以被多个物体共享
+    Mesh &mesh;
+    // 实例化绘制：非空时网格按每个实例矩阵（相对于 transform）各画一次，所有实例共用同一份网格数据；为空时只按 transform 画一次
+    std::vector<Matrix4f> instances;
+    std::vector<Mesh> lods; // 逐级简化的网格（objl::build_lod_chain），lods[i] 为第 i + 1 级；为空时总是绘制 mesh
 
-    std::vector<Triangle> &Triangles;
+    // 网格的包围盒；有实例时为所有实例包围盒的并集
+    AABB local_bounds() const override
+    {
+        if (mesh.vertex_count() == 0)
+            return {};
+        AABB box(mesh.bounds_min, mesh.bounds_max);
+        if (instances.empty())
+            return box;
+        AABB all;
+        for (const Matrix4f &instance : instances)
+            all.expand(box.transformed(instance));
+        return all;
+    }
 };
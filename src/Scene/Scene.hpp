@@ -1,4 +1,5 @@
 ﻿#pragma once
+#include "BVH.hpp"
 #include "Object.hpp"
 
 struct Light
@@ -61,7 +62,11 @@ public:
         clear_objects();        // 清空场景中的物体
         add(std::move(object)); // 添加新的物体
     }
-    void add(std::unique_ptr<Object> object) { objects.push_back(std::move(object)); }
+    void add(std::unique_ptr<Object> object)
+    {
+        objects.push_back(std::move(object));
+        bvh_dirty = true;
+    }
     void add(std::unique_ptr<Light> light) { lights.push_back(std::move(light)); }
     void set_camera(std::shared_ptr<Camera> _camera) { camera = std::move(_camera); }
 
@@ -73,7 +78,38 @@ public:
 
     float get_filedofView() const { return filedofView; }
     float get_aspect_ratio() const { return aspect_ratio; }
-    void clear_objects() { objects.clear(); }
+    void clear_objects()
+    {
+        objects.clear();
+        bvh_dirty = true;
+    }
+
+    // 第 index 个物体加入场景后修改了 transform 或实例时调用，下次取 BVH 时更新它的包围盒
+    void mark_moved(size_t index) { moved.push_back(index); }
+
+    // 物体 BVH，包围盒位于场景空间（物体的 transform 之后、光栅化器的 set_model 之前）
+    // 增删物体后重建；只有少数物体移动时沿叶子到根 refit，移动的物体很多时重建以保持树的质量
+    const ObjectBVH &get_bvh()
+    {
+        if (moved.size() > objects.size() / 4)
+            bvh_dirty = true;
+        if (bvh_dirty)
+        {
+            std::vector<AABB> bounds;
+            bounds.reserve(objects.size());
+            for (const auto &object : objects)
+                bounds.push_back(object->get_bounds());
+            bvh.build(std::move(bounds));
+        }
+        else
+        {
+            for (size_t index : moved)
+                bvh.refit(index, objects[index]->get_bounds());
+        }
+        bvh_dirty = false;
+        moved.clear();
+        return bvh;
+    }
 
 private:
     Scene(size_t w, size_t h, float fov) : width(w), height(h), filedofView(fov) { aspect_ratio = static_cast<float>(w / h); }
@@ -84,5 +120,8 @@ private:
     float filedofView;
     std::vector<std::unique_ptr<Object>> objects;
     std::vector<std::unique_ptr<Light>> lights;
+    ObjectBVH bvh;
+    bool bvh_dirty = true;
+    std::vector<size_t> moved; // 等待 refit 的物体
     std::shared_ptr<Camera> camera;
 };
\ No newline at end of file
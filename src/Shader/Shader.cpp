@@ -1,167 +1,63 @@
 ﻿#include "Shader.h"
+#include "rasterizer_pipeline.hpp"
 
-Vec3f normal_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &ras)
+// Blinn-Phong 光照：kd 为漫反射系数（0~1），返回 0~1 的颜色
+// 视线方向对所有光源相同，只计算一次；环境光只累加一次
+static Vec3f blinn_phong(const Vec3f &point, const Vec3f &normal, const Vec3f &kd, const rst::shading_uniforms &uniforms)
 {
-    Vec3f result_color = (payload.normal + Vec3f{1.0f, 1.0f, 1.0f}) / 2;
-
-    return result_color * 255;
-}
-
-Vec3f white_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &ras)
-{
-    Vec3f white_color = Vec3f{255.f, 255.f, 255.f};
-
-    // 获取法线和光照信息
-    const Vec3f &normal = payload.normal;
-    Vec3f result_color = {0.f, 0.f, 0.f};
+    // 视线方向
+    Vec3f view_dir = (uniforms.eye_pos - point).normalize();
 
-    // 遍历所有光源
-    for (const auto &light : ras.get_scene()->get_lights())
+    Vec3f result_color = uniforms.ambient;
+    for (int i = 0; i < uniforms.light_count; ++i)
     {
-        // 计算光照方向
-        Vec3f light_dir = (light->position - payload.view_pos).normalize();
-
-        // 计算漫反射强度
-        float diffuse = std::max(0.f, normal * light_dir);
-
-        // 计算光照衰减（假设光源强度随距离平方衰减）
-        float r_squared = (light->position - payload.view_pos).norm() * (light->position - payload.view_pos).norm();
-        Vec3f light_intensity = light->intensity / r_squared;
-
-        // 叠加光照效果
-        result_color += white_color.cwiseProduct(light_intensity) * diffuse;
-    }
+        const auto &light = uniforms.lights[i];
 
-    // 添加环境光
-    result_color += ras.get_material()->Ka.cwiseProduct(payload.amb_light_intensity);
-
-    return result_color;
-}
-
-Vec3f phong_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &ras)
-{
-    auto material = ras.get_material();
-
-    Vec3f ka = material->Ka;
-    Vec3f kd = payload.color;
-    Vec3f ks = material->Ks;
-
-    Vec3f amb_light_intensity = payload.amb_light_intensity; // 环境光强度
-    auto eye_pos = ras.get_scene()->get_camera()->eye_pos;         // 相机位置
-    float p = material->specularExponent;                          // 高光指数
-
-    Vec3f point = payload.view_pos;
-    Vec3f normal = payload.normal;
-
-    Vec3f result_color = {0, 0, 0};
-    for (auto &light : ras.get_scene()->get_lights())
-    {
-        // 光照方向
-        Vec3f light_dir = (light->position - point).normalize();
-        // 视线方向
-        Vec3f view_dir = (eye_pos - point).normalize();
+        // 光照方向与衰减
+        Vec3f light_vec = light.position - point;
+        float r_r = light_vec * light_vec;
+        Vec3f light_dir = light_vec.normalize();
         // 半程向量
         Vec3f half_dir = (light_dir + view_dir).normalize();
 
-        // 光照衰减
-        float r_r = (light->position - point) * (light->position - point);
-
         // 漫反射
         float diffuse = std::max(0.0f, normal * light_dir);
 
         // 镜面反射
-        float specular = std::pow(std::max(0.0f, normal * half_dir), p);
+        float specular = std::pow(std::max(0.0f, normal * half_dir), uniforms.specular_exponent);
 
         // diffuse
-        Vec3f ld = kd.cwiseProduct(light->intensity / r_r) * diffuse;
-        // specular
-        Vec3f ls = ks.cwiseProduct(light->intensity / r_r) * specular;
-        // ambient
-        Vec3f la = ka.cwiseProduct(amb_light_intensity);
+        Vec3f ld = kd.cwiseProduct(light.intensity / r_r) * diffuse;
+        // specular（光强已预乘镜面反射系数）
+        Vec3f ls = light.specular / r_r * specular;
 
-        result_color += (la + ld + ls);
+        result_color += (ld + ls);
     }
 
-    return result_color * 255;
+    return result_color;
 }
 
-Vec3f texture_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &ras)
-{
-    auto material = ras.get_material();
-    Vec3f texture_color = material->map_Kd.has_value() ? material->map_Kd->getColor(payload.tex_coords.x, payload.tex_coords.y) : Vec3f{0, 0, 0};
-
-    // 材质属性
-    Vec3f ka = material->Ka;          // 环境光系数
-    Vec3f kd = texture_color / 255.f; // 漫反射系数
-    Vec3f ks = material->Ks;          // 镜面反射系数
-
-    // 相机属性
-    Vec3f amb_light_intensity = payload.amb_light_intensity;      // 环境光强度
-    auto eye_pos = ras.get_scene()->get_camera()->eye_pos;                // 相机位置
-    float p = material->specularExponent; // 高光指数
-
-    Vec3f point = payload.view_pos;
-    Vec3f normal = payload.normal;
-
-    Vec3f result_color = {0, 0, 0};
-
-    for (auto &light : ras.get_scene()->get_lights())
-    {
-        // 光照方向
-        Vec3f light_dir = (light->position - point).normalize();
-        // 视线方向
-        Vec3f view_dir = (eye_pos - point).normalize();
-        // 半程向量
-        Vec3f half_dir = (light_dir + view_dir).normalize();
-
-        // 光照衰减
-        float r_r = (light->position - point) * (light->position - point);
-
-        // 漫反射
-        float diffuse = std::max(0.0f, normal * light_dir);
-
-        // 镜面反射
-        float specular = std::pow(std::max(0.0f, normal * half_dir), p);
-
-        // diffuse
-        Vec3f ld = kd.cwiseProduct(light->intensity / r_r) * diffuse;
-        // specular
-        Vec3f ls = ks.cwiseProduct(light->intensity / r_r) * specular;
-        // ambient
-        Vec3f la = ka.cwiseProduct(amb_light_intensity);
-
-        result_color += (la + ld + ls);
-    }
+constexpr float bump_kh = 0.2f, bump_kn = 0.1f; // kh 和 kn 是控制凹凸效果的参数
 
-    return result_color * 255;
+// 凹凸贴图在 (u, v) 处的高度梯度，乘上凹凸参数；没有凹凸贴图时高度为常数，梯度为 0
+// 梯度在加载时按每级 mipmap 预先求好，这里按像素覆盖的纹素范围选择层级，只采样一次
+static Texture::gradient bump_gradient(const rst::shading_uniforms &uniforms, float u, float v, const Vec2f &duv_dx, const Vec2f &duv_dy)
+{
+    if (!uniforms.bump_gradient)
+        return {0.f, 0.f};
+    auto g = uniforms.bump_gradient->getGradient(u, v, uniforms.bump_gradient->getLod(duv_dx, duv_dy));
+    return {bump_kh * bump_kn * g.du, bump_kh * bump_kn * g.dv};
 }
 
-Vec3f bump_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &ras)
+// 根据凹凸贴图的梯度扰动法线
+static Vec3f bump_normal(const Vec3f &normal, const Texture::gradient &g)
 {
-    auto material = ras.get_material();
-    Vec3f normal = payload.normal;
-
-    float kh = 0.2f, kn = 0.1f; // kh 和 kn 是控制凹凸效果的参数
-
-    // 用于从纹理中获取颜色并计算其亮度（norm）
-    auto texture_intensity = [&payload, &material](const float u, const float v)
-    {
-        return material->map_bump.has_value() ? material->map_bump->getColor(u, v).norm() : 1.f;
-    };
 
     // 获取当前法线的 x, y, z 分量
     float x = normal.x;
     float y = normal.y;
     float z = normal.z;
 
-    // 获取纹理坐标 u, v
-    float u = payload.tex_coords.x;
-    float v = payload.tex_coords.y;
-
-    // 获取凹凸贴图的宽度和高度
-    auto w = material->map_Kd->getWidth();
-    auto h = material->map_Kd->getHeight();
-
     // 计算切线向量 tangent
     float sqrt_xz = sqrt(x * x + z * z);
     auto tangent = Vec3f{x * y / sqrt_xz, - sqrt_xz, z * y / sqrt_xz};
@@ -172,136 +68,330 @@ Vec3f bump_fragment_shader(const rst::pixel_shader_payload &payload, rst::raster
     // 构建 TBN 矩阵，TBN 矩阵用于将局部坐标系中的向量转换到世界坐标系
     Matrix3f TBN{{tangent, bitangent, normal}};
 
-    // 计算 u 方向的梯度 du，通过纹理坐标的微小变化来计算高度变化
-    float du = kh * kn * (texture_intensity(u + 1.f / w, v) - texture_intensity(u, v));
+    // 计算局部法线 ln，根据梯度 du 和 dv 调整法线
+    auto ln = Vec3f{-g.du, -g.dv, 1.f};
+    return (TBN * ln).normalize();
+}
 
-    // 计算 v 方向的梯度 dv
-    float dv = kh * kn * (texture_intensity(u, v + 1.f / h) - texture_intensity(u, v));
+// 法线贴图在 (u, v) 处的切线空间法线，纹素 0~255 映射到 [-1, 1]；按像素覆盖范围选一级 mipmap 做一次双线性采样
+static Vec3f tangent_space_normal(const Texture &normal_map, float u, float v, const Vec2f &duv_dx, const Vec2f &duv_dy)
+{
+    int level = static_cast<int>(normal_map.getLod(duv_dx, duv_dy) + 0.5f);
+    return normal_map.getColorBilinear(u, v, level) * (2.f / 255.f) - Vec3f{1.f, 1.f, 1.f};
+}
 
-    // 计算局部法线 ln，根据梯度 du 和 dv 调整法线
-    auto ln = Vec3f{-du, -dv, 1.f};
-    normal = (TBN * ln).normalize();
+Vec3f normal_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &) const
+{
+    Vec3f result_color = (payload.normal + Vec3f{1.0f, 1.0f, 1.0f}) / 2;
 
-    // 返回扰动后的法线向量
-    return normal * 255;
+    return result_color * 255;
 }
 
-Vec3f displacement_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &ras)
+Vec3f white_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const
 {
-    auto material = ras.get_material();
-    Vec3f bump_color = material->map_bump.has_value() ? material->map_bump->getColor(payload.tex_coords.x, payload.tex_coords.y) : Vec3f{0, 0, 0};
+    Vec3f white_color = Vec3f{255.f, 255.f, 255.f};
 
-    Vec3f ka = material->Ka;
-    Vec3f kd = bump_color / 255;
-    Vec3f ks = material->Ks;
+    // 获取法线和光照信息
+    const Vec3f &normal = payload.normal;
+    Vec3f result_color = {0.f, 0.f, 0.f};
 
-    // 相机属性
-    Vec3f amb_light_intensity = payload.amb_light_intensity; // 环境光强度
-    auto eye_pos = ras.get_scene()->get_camera()->eye_pos;   // 相机位置
-    float p = material->specularExponent;             // 高光指数
+    // 遍历所有光源
+    for (int i = 0; i < uniforms.light_count; ++i)
+    {
+        const auto &light = uniforms.lights[i];
 
-    Vec3f point = payload.view_pos;
-    Vec3f normal = payload.normal;
+        // 计算光照方向
+        Vec3f light_vec = light.position - payload.view_pos;
+        float r_squared = light_vec * light_vec;
+        Vec3f light_dir = light_vec.normalize();
 
-    float kh = 0.2f, kn = 0.1f; // kh 和 kn 是控制凹凸效果的参数
+        // 计算漫反射强度
+        float diffuse = std::max(0.f, normal * light_dir);
+
+        // 计算光照衰减（假设光源强度随距离平方衰减）
+        Vec3f light_intensity = light.intensity / r_squared;
+
+        // 叠加光照效果
+        result_color += white_color.cwiseProduct(light_intensity) * diffuse;
+    }
+
+    // 添加环境光
+    result_color += uniforms.ambient;
+
+    return result_color;
+}
+
+Vec3f phong_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const
+{
+    return blinn_phong(payload.view_pos, payload.normal, payload.color, uniforms) * 255;
+}
 
-    auto texture_intensity = [&payload, &material](const float u, const float v)
+Vec3f texture_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const
+{
+    Vec3f texture_color = {0, 0, 0};
+    if (uniforms.diffuse_map)
     {
-        return material->map_bump.has_value() ? material->map_bump->getColor(u, v).norm() : 1.f;
-    };
+        // 按像素覆盖的纹素范围选择 mipmap 层级，三线性采样
+        float lod = uniforms.diffuse_map->getLod(payload.tex_dx, payload.tex_dy);
+        texture_color = uniforms.diffuse_map->getColorTrilinear(payload.tex_coords.x, payload.tex_coords.y, lod);
+    }
 
-    // 获取当前法线的 x, y, z 分量
-    float x = normal.x;
-    float y = normal.y;
-    float z = normal.z;
+    return blinn_phong(payload.view_pos, payload.normal, texture_color / 255.f, uniforms) * 255;
+}
 
-    // 获取纹理坐标 u, v
+Vec3f bump_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const
+{
+    // 返回扰动后的法线向量
+    auto g = bump_gradient(uniforms, payload.tex_coords.x, payload.tex_coords.y, payload.tex_dx, payload.tex_dy);
+    return bump_normal(payload.normal, g) * 255;
+}
+
+Vec3f displacement_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const
+{
     float u = payload.tex_coords.x;
     float v = payload.tex_coords.y;
 
-    // 获取纹理的宽度和高度
-    auto w = material->map_Kd->getWidth();
-    auto h = material->map_Kd->getHeight();
+    // 凹凸贴图的颜色兼作高度（模长），没有凹凸贴图时高度为常数 1
+    Vec3f bump_color = uniforms.bump_map ? uniforms.bump_map->getColor(u, v) : Vec3f{0, 0, 0};
+    float height = uniforms.bump_map ? bump_color.norm() : 1.f;
+    Vec3f normal = bump_normal(payload.normal, bump_gradient(uniforms, u, v, payload.tex_dx, payload.tex_dy));
 
-    // 计算切线向量 tangent
-    float sqrt_xz = sqrt(x * x + z * z);
-    auto tangent = Vec3f{x * y / sqrt_xz, - sqrt_xz, z * y / sqrt_xz};
+    // 移动顶点高度
+    Vec3f point = payload.view_pos + bump_kn * normal * height;
 
-    // 计算副切线向量 bitangent，通过法线和切线的叉积得到
-    auto bitangent = (normal ^ tangent).normalize();
+    return blinn_phong(point, normal, bump_color / 255, uniforms) * 255;
+}
 
-    // 构建 TBN 矩阵，TBN 矩阵用于将局部坐标系中的向量转换到世界坐标系
-    Matrix3f TBN{{tangent, bitangent, normal}};
+Vec3f normal_map_fragment_shader::operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const
+{
+    const float u = payload.tex_coords.x, v = payload.tex_coords.y;
+    Vec3f normal = payload.normal;
+    if (uniforms.normal_map)
+    {
+        // TBN：切线沿用顶点插值的结果，副切线由法线和切线叉乘得到，不再逐片元构造切线
+        Vec3f ts = tangent_space_normal(*uniforms.normal_map, u, v, payload.tex_dx, payload.tex_dy);
+        const Vec3f &tangent = payload.tangent;
+        Vec3f bitangent = (payload.normal ^ tangent) * payload.bitangent_sign;
+        normal = (tangent * ts.x + bitangent * ts.y + payload.normal * ts.z).normalize();
+    }
 
-    // 计算 u 方向的梯度 du，通过纹理坐标的微小变化来计算高度变化
-    float du = kh * kn * (texture_intensity(u + 1.f / w, v) - texture_intensity(u, v));
+    // 有漫反射贴图时与纹理着色器一样三线性采样，否则使用顶点颜色
+    Vec3f kd = payload.color;
+    if (uniforms.diffuse_map)
+    {
+        float lod = uniforms.diffuse_map->getLod(payload.tex_dx, payload.tex_dy);
+        kd = uniforms.diffuse_map->getColorTrilinear(u, v, lod) / 255.f;
+    }
 
-    // 计算 v 方向的梯度 dv
-    float dv = kh * kn * (texture_intensity(u, v + 1.f / h) - texture_intensity(u, v));
+    return blinn_phong(payload.view_pos, normal, kd, uniforms) * 255;
+}
 
-    // 计算局部法线 ln，根据梯度 du 和 dv 调整法线
-    auto ln = Vec3f{-du, -dv, 1.f};
-    normal = (TBN * ln).normalize();
+// ---------------- 批量着色 ----------------
+// 每个通道的计算与上面逐片元的版本相同；先在标量循环里完成纹理采样、pow 等无法向量化的部分，
+// 其余按通道循环的算术都写成固定 8 次、只访问 SoA 数组的循环，方便编译器向量化
 
-    // 移动顶点高度
-    point += kn * normal * texture_intensity(u, v);
+constexpr int lanes = rst::fragment_lanes;
+
+// 与 Vec::normalize 一致：长度为 0 时保持原向量不变
+static inline float inv_length(float x, float y, float z)
+{
+    float n = std::sqrt(x * x + y * y + z * z);
+    return n == 0.f ? 1.f : 1.f / n;
+}
 
-    Vec3f result_color = {0, 0, 0};
+// 对一批片元做 Blinn-Phong 光照，kd 为每个通道的漫反射系数，结果乘 255 写入 batch.result
+static void blinn_phong_batch(rst::fragment_batch &batch, const rst::fragment_lanes3 &kd, const rst::shading_uniforms &uniforms)
+{
+    const Vec3f eye_pos = uniforms.eye_pos;
+    const float p = uniforms.specular_exponent; // 高光指数
 
-    for (auto &light : ras.get_scene()->get_lights())
+    // 视线方向对所有光源相同
+    alignas(32) float view_x[lanes], view_y[lanes], view_z[lanes];
+    for (int i = 0; i < lanes; ++i)
     {
-        // 光照方向
-        Vec3f light_dir = (light->position - point).normalize();
-        // 视线方向
-        Vec3f view_dir = (eye_pos - point).normalize();
-        // 半程向量
-        Vec3f half_dir = (light_dir + view_dir).normalize();
+        float vx = eye_pos.x - batch.view_pos.x[i], vy = eye_pos.y - batch.view_pos.y[i], vz = eye_pos.z - batch.view_pos.z[i];
+        float inv_v = inv_length(vx, vy, vz);
+        view_x[i] = vx * inv_v;
+        view_y[i] = vy * inv_v;
+        view_z[i] = vz * inv_v;
+    }
 
-        // 光照衰减
-        float r_r = (light->position - point) * (light->position - point);
+    alignas(32) float r[lanes], g[lanes], b[lanes];
+    for (int i = 0; i < lanes; ++i)
+    {
+        r[i] = uniforms.ambient.x;
+        g[i] = uniforms.ambient.y;
+        b[i] = uniforms.ambient.z;
+    }
 
-        // 漫反射
-        float diffuse = std::max(0.0f, normal * light_dir);
+    alignas(32) float diffuse[lanes], specular[lanes], r_r[lanes];
+    for (int l = 0; l < uniforms.light_count; ++l)
+    {
+        const auto &light = uniforms.lights[l];
+        for (int i = 0; i < lanes; ++i)
+        {
+            // 光照方向
+            float lx = light.position.x - batch.view_pos.x[i], ly = light.position.y - batch.view_pos.y[i], lz = light.position.z - batch.view_pos.z[i];
+            r_r[i] = lx * lx + ly * ly + lz * lz; // 光照衰减
+            float inv_l = inv_length(lx, ly, lz);
+            lx *= inv_l, ly *= inv_l, lz *= inv_l;
+
+            // 半程向量
+            float hx = lx + view_x[i], hy = ly + view_y[i], hz = lz + view_z[i];
+            float inv_h = inv_length(hx, hy, hz);
+
+            float nx = batch.normal.x[i], ny = batch.normal.y[i], nz = batch.normal.z[i];
+            diffuse[i] = std::max(0.0f, nx * lx + ny * ly + nz * lz);
+            specular[i] = std::max(0.0f, nx * hx * inv_h + ny * hy * inv_h + nz * hz * inv_h);
+        }
 
         // 镜面反射
-        float specular = std::pow(std::max(0.0f, normal * half_dir), p);
+        for (int i = 0; i < lanes; ++i)
+            specular[i] = std::pow(specular[i], p);
+
+        for (int i = 0; i < lanes; ++i)
+        {
+            r[i] += kd.x[i] * (light.intensity.x / r_r[i]) * diffuse[i] + light.specular.x / r_r[i] * specular[i];
+            g[i] += kd.y[i] * (light.intensity.y / r_r[i]) * diffuse[i] + light.specular.y / r_r[i] * specular[i];
+            b[i] += kd.z[i] * (light.intensity.z / r_r[i]) * diffuse[i] + light.specular.z / r_r[i] * specular[i];
+        }
+    }
 
-        // diffuse
-        Vec3f ld = kd.cwiseProduct(light->intensity / r_r) * diffuse;
-        // specular
-        Vec3f ls = ks.cwiseProduct(light->intensity / r_r) * specular;
-        // ambient
-        Vec3f la = ka.cwiseProduct(amb_light_intensity);
+    for (int i = 0; i < lanes; ++i)
+    {
+        batch.result.x[i] = r[i] * 255;
+        batch.result.y[i] = g[i] * 255;
+        batch.result.z[i] = b[i] * 255;
+    }
+}
 
-        result_color += (la + ld + ls);
+void normal_fragment_shader::shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &) const
+{
+    for (int i = 0; i < lanes; ++i)
+    {
+        batch.result.x[i] = (batch.normal.x[i] + 1.0f) / 2 * 255;
+        batch.result.y[i] = (batch.normal.y[i] + 1.0f) / 2 * 255;
+        batch.result.z[i] = (batch.normal.z[i] + 1.0f) / 2 * 255;
     }
+}
 
-    return result_color * 255;
+void phong_fragment_shader::shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const
+{
+    blinn_phong_batch(batch, batch.color, uniforms);
 }
 
-void vertex_shader(rst::vertex_shader_payload &payload, Triangle *t)
+void texture_fragment_shader::shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const
 {
-    auto t_Vec4 = t->toVector4(t->get_vertex(), 1.f);
+    // 纹理采样是逐通道的随机访问
+    rst::fragment_lanes3 kd;
+    for (int i = 0; i < lanes; ++i)
+    {
+        Vec3f texture_color = {0, 0, 0};
+        if (uniforms.diffuse_map)
+        {
+            float lod = uniforms.diffuse_map->getLod({batch.du_dx[i], batch.dv_dx[i]}, {batch.du_dy[i], batch.dv_dy[i]});
+            texture_color = uniforms.diffuse_map->getColorTrilinear(batch.u[i], batch.v[i], lod);
+        }
+        kd.x[i] = texture_color.x / 255.f;
+        kd.y[i] = texture_color.y / 255.f;
+        kd.z[i] = texture_color.z / 255.f;
+    }
 
-    auto &viewspace_pos = t->get_viewspace_pos();
-    auto &normal = t->get_normal();
+    blinn_phong_batch(batch, kd, uniforms);
+}
 
-    viewspace_pos = {
-        (payload.view * payload.model * t_Vec4[0]).head<3>(),
-        (payload.view * payload.model * t_Vec4[1]).head<3>(),
-        (payload.view * payload.model * t_Vec4[2]).head<3>()};
+void bump_fragment_shader::shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const
+{
+    // 凹凸贴图在 u、v 方向的高度梯度，每个通道一次采样
+    alignas(32) float du[lanes], dv[lanes];
+    for (int i = 0; i < lanes; ++i)
+    {
+        auto g = bump_gradient(uniforms, batch.u[i], batch.v[i], {batch.du_dx[i], batch.dv_dx[i]}, {batch.du_dy[i], batch.dv_dy[i]});
+        du[i] = g.du;
+        dv[i] = g.dv;
+    }
 
-    normal = {
-        (payload.inv_trans * normal[0].toVector4(0.0f)).head<3>(),
-        (payload.inv_trans * normal[1].toVector4(0.0f)).head<3>(),
-        (payload.inv_trans * normal[2].toVector4(0.0f)).head<3>()};
+    for (int i = 0; i < lanes; ++i)
+    {
+        float x = batch.normal.x[i], y = batch.normal.y[i], z = batch.normal.z[i];
+
+        // 切线 tangent
+        float sqrt_xz = std::sqrt(x * x + z * z);
+        float tx = x * y / sqrt_xz, ty = -sqrt_xz, tz = z * y / sqrt_xz;
+
+        // 副切线 bitangent = normal ^ tangent
+        float bx = y * tz - z * ty, by = z * tx - x * tz, bz = x * ty - y * tx;
+        float inv_b = inv_length(bx, by, bz);
+        bx *= inv_b, by *= inv_b, bz *= inv_b;
+
+        // ln = (-du, -dv, 1)，扰动后的法线 = TBN * ln
+        float rx = tx * -du[i] + bx * -dv[i] + x;
+        float ry = ty * -du[i] + by * -dv[i] + y;
+        float rz = tz * -du[i] + bz * -dv[i] + z;
+        float inv_r = inv_length(rx, ry, rz);
+
+        batch.result.x[i] = rx * inv_r * 255;
+        batch.result.y[i] = ry * inv_r * 255;
+        batch.result.z[i] = rz * inv_r * 255;
+    }
+}
 
-    for (int i = 0; i < 3; ++i)
+void normal_map_fragment_shader::shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const
+{
+    // 纹理采样逐通道进行；没有法线贴图时切线空间法线为 (0, 0, 1)，即保持插值法线不变
+    rst::fragment_lanes3 kd, ts;
+    for (int i = 0; i < lanes; ++i)
     {
-        // 将顶点从模型空间转换到裁剪空间（NDC）
-        Vec4f v = payload.mvp * t_Vec4[i];
-        v /= v.w();
+        Vec2f duv_dx{batch.du_dx[i], batch.dv_dx[i]}, duv_dy{batch.du_dy[i], batch.dv_dy[i]};
+        Vec3f n = uniforms.normal_map ? tangent_space_normal(*uniforms.normal_map, batch.u[i], batch.v[i], duv_dx, duv_dy) : Vec3f{0.f, 0.f, 1.f};
+        ts.x[i] = n.x, ts.y[i] = n.y, ts.z[i] = n.z;
+
+        Vec3f color{batch.color.x[i], batch.color.y[i], batch.color.z[i]};
+        if (uniforms.diffuse_map)
+            color = uniforms.diffuse_map->getColorTrilinear(batch.u[i], batch.v[i], uniforms.diffuse_map->getLod(duv_dx, duv_dy)) / 255.f;
+        kd.x[i] = color.x, kd.y[i] = color.y, kd.z[i] = color.z;
+    }
 
-        t->setVertex(i, v.head<3>());
+    // 法线 = T * ts.x + B * ts.y + N * ts.z，B = sign * (N × T)，结果写回 batch.normal 供光照使用
+    const float sign = batch.bitangent_sign;
+    for (int i = 0; i < lanes; ++i)
+    {
+        float nx = batch.normal.x[i], ny = batch.normal.y[i], nz = batch.normal.z[i];
+        float tx = batch.tangent.x[i], ty = batch.tangent.y[i], tz = batch.tangent.z[i];
+        float bx = sign * (ny * tz - nz * ty), by = sign * (nz * tx - nx * tz), bz = sign * (nx * ty - ny * tx);
+        float rx = tx * ts.x[i] + bx * ts.y[i] + nx * ts.z[i];
+        float ry = ty * ts.x[i] + by * ts.y[i] + ny * ts.z[i];
+        float rz = tz * ts.x[i] + bz * ts.y[i] + nz * ts.z[i];
+        float inv_r = inv_length(rx, ry, rz);
+        batch.normal.x[i] = rx * inv_r;
+        batch.normal.y[i] = ry * inv_r;
+        batch.normal.z[i] = rz * inv_r;
     }
-}
\ No newline at end of file
+
+    blinn_phong_batch(batch, kd, uniforms);
+}
+
+rst::vertex_shader_output vertex_shader::operator()(const rst::vertex_shader_payload &payload, const Vec3f &position, const Vec3f &normal, const Vec4f &tangent) const
+{
+    auto pos = position.toVector4(1.f);
+
+    rst::vertex_shader_output out;
+    out.view_pos = (payload.model_view * pos).head<3>();
+    out.normal = (payload.inv_trans * normal.toVector4(0.0f)).head<3>();
+    // 切线在表面内，与位置一样用模型视图矩阵变换
+    Vec3f view_tangent = (payload.model_view * tangent.head<3>().toVector4(0.0f)).head<3>();
+    out.tangent = Vec4f{view_tangent.x, view_tangent.y, view_tangent.z, tangent.w()};
+    // 将顶点从模型空间转换到齐次裁剪空间，透视除法在光栅化器完成裁剪之后再做
+    out.clip_pos = payload.mvp * pos;
+    return out;
+}
+
+// 预先实例化各着色器对应的管线，着色器定义在本文件中可见，会被内联进顶点处理与光栅化循环
+template void rst::rasterizer::process_vertices<vertex_shader>(const Mesh &);
+template void rst::rasterizer::rasterize_setup_triangle<normal_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
+template void rst::rasterizer::rasterize_setup_triangle<white_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
+template void rst::rasterizer::rasterize_setup_triangle<phong_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
+template void rst::rasterizer::rasterize_setup_triangle<texture_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
+template void rst::rasterizer::rasterize_setup_triangle<bump_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
+template void rst::rasterizer::rasterize_setup_triangle<displacement_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
+template void rst::rasterizer::rasterize_setup_triangle<normal_map_fragment_shader>(const rst::triangle_setup &, int, int, int, int);
@@ -3,11 +3,38 @@
 #include "Scene.hpp"
 #include "rasterizer.h"
 
-Vec3f normal_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &);
-Vec3f white_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &);
-Vec3f phong_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &);
-Vec3f texture_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &);
-Vec3f bump_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &);
-Vec3f displacement_fragment_shader(const rst::pixel_shader_payload &payload, rst::rasterizer &);
+// 着色器是无状态的函数对象，作为渲染管线的模板参数使用：
+// 对应的管线在 Shader.cpp 中与着色器定义一起显式实例化，着色器在光栅化循环中内联展开
+// 用法：ras.set_fragment_shader(rst::rasterizer::fragment_pipeline<phong_fragment_shader>());
+// 提供 shade_batch 的着色器一次处理 8 个片元（SoA），结果与逐片元版本一致
+// 光源、材质等常量从每次绘制前准备好的 uniforms 中读取，着色都在视空间中进行
+struct normal_fragment_shader
+{
+    Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const;
+    void shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const;
+};
+struct white_fragment_shader { Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const; };
+struct phong_fragment_shader
+{
+    Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const;
+    void shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const;
+};
+struct texture_fragment_shader
+{
+    Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const;
+    void shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const;
+};
+struct bump_fragment_shader
+{
+    Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const;
+    void shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const;
+};
+struct displacement_fragment_shader { Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const; };
+// 切线空间法线贴图：每个片元取一次法线贴图，经插值得到的 TBN 变换到视空间后做光照
+struct normal_map_fragment_shader
+{
+    Vec3f operator()(const rst::pixel_shader_payload &payload, const rst::shading_uniforms &uniforms) const;
+    void shade_batch(rst::fragment_batch &batch, const rst::shading_uniforms &uniforms) const;
+};
 
-void vertex_shader(rst::vertex_shader_payload &payload, Triangle *t);
+struct vertex_shader { rst::vertex_shader_output operator()(const rst::vertex_shader_payload &payload, const Vec3f &position, const Vec3f &normal, const Vec4f &tangent) const; };
@@ -1,13 +1,187 @@
 #include "Texture.h"
+#include <cmath>
+#include <cstring>
+#include <new>
 
-Vec3f Texture::getColor(float u, float v)
+namespace
 {
-    u = std::clamp(u, 0.0f, 1.0f);
-    v = std::clamp(v, 0.0f, 1.0f);
-    
-    auto u_img = static_cast<int>(u * (width - 1));
-    auto v_img = static_cast<int>((1 - v) * (height - 1));
+    // 缩小一半时目标纹素沿一个轴覆盖的源纹素及其权重：
+    // 源边长为偶数时是相邻 2 个源纹素各占一半；为奇数 2n + 1 时目标边长为 n，每个目标纹素覆盖 3 个源纹素，
+    // 权重为 (n - x, n, x + 1) / (2n + 1)，每个源纹素（包括最后一行/列）对下一级的总贡献相同；源边长为 1 时直接复制
+    struct downsample_taps
+    {
+        int index[3];
+        float weight[3];
+        int count;
+    };
 
-    auto color = image_data.at<cv::Vec3b>(v_img, u_img);
-    return Vec3f{static_cast<float>(color[0]), static_cast<float>(color[1]), static_cast<float>(color[2])};
-}
\ No newline at end of file
+    downsample_taps get_downsample_taps(int x, int src_size, int dst_size)
+    {
+        if (src_size == 1)
+            return {{0, 0, 0}, {1.f, 0.f, 0.f}, 1};
+        if (src_size % 2 == 0)
+            return {{2 * x, 2 * x + 1, 0}, {0.5f, 0.5f, 0.f}, 2};
+        const float n = static_cast<float>(dst_size), total = 2.f * n + 1.f;
+        return {{2 * x, 2 * x + 1, 2 * x + 2}, {(n - x) / total, n / total, (x + 1) / total}, 3};
+    }
+}
+
+template <class T>
+Texture::tiled_storage<T>::tiled_storage(std::vector<mip_level> layout) : levels(std::move(layout))
+{
+    const mip_level &last = levels.back();
+    texel_count = last.offset + static_cast<size_t>(last.tiles_x) * ((last.height + tile_size - 1) / tile_size) * tile_texels;
+    texels = static_cast<T *>(::operator new(texel_count * sizeof(T), std::align_val_t{tile_texels * sizeof(T)}));
+    std::memset(texels, 0, texel_count * sizeof(T)); // 补齐的纹素不会被采样，清零只为内容确定
+}
+
+template <class T>
+Texture::tiled_storage<T>::~tiled_storage()
+{
+    ::operator delete(texels, std::align_val_t{tile_texels * sizeof(T)});
+}
+
+std::vector<Texture::mip_level> Texture::mip_layout(int width, int height)
+{
+    std::vector<mip_level> layout{{width, height, 0, 0}};
+    while (layout.back().width > 1 || layout.back().height > 1)
+        layout.push_back({std::max(layout.back().width / 2, 1), std::max(layout.back().height / 2, 1), 0, 0});
+
+    size_t offset = 0;
+    for (auto &level : layout)
+    {
+        level.tiles_x = (level.width + tile_size - 1) / tile_size;
+        level.offset = offset;
+        offset += static_cast<size_t>(level.tiles_x) * ((level.height + tile_size - 1) / tile_size) * tile_texels;
+    }
+    return layout;
+}
+
+Texture::Texture(const Texture &source, TextureFormat format)
+    : path(source.path), format(format), width(source.width), height(source.height)
+{
+    if (!source.storage)
+    {
+        LOGE("Texture {} has no color texels to convert", source.path);
+        throw std::runtime_error("Invalid source texture");
+    }
+    switch (format)
+    {
+    case TextureFormat::Color:
+        storage = source.storage;
+        break;
+    case TextureFormat::HeightGradient:
+        build_height_gradients(*source.storage);
+        break;
+    }
+    valid = true;
+}
+
+void Texture::build_mipmaps(const cv::Mat &image)
+{
+    // 先按行生成各级 mipmap：每级由上一级 2x2 的纹素取平均（盒式滤波）；上一级边长为奇数时该方向改用 3 个纹素的加权平均，
+    // 最后一行/列也参与滤波（get_downsample_taps）
+    const std::vector<mip_level> layout = mip_layout(image.cols, image.rows);
+    std::vector<std::vector<texel>> rows(1);
+    rows[0].resize(static_cast<size_t>(image.cols) * image.rows);
+    for (int y = 0; y < image.rows; ++y)
+    {
+        const cv::Vec3b *row = image.ptr<cv::Vec3b>(y);
+        for (int x = 0; x < image.cols; ++x)
+            rows[0][static_cast<size_t>(y) * image.cols + x] = {row[x][0], row[x][1], row[x][2], 0};
+    }
+    for (size_t i = 1; i < layout.size(); ++i)
+    {
+        const mip_level &src = layout[i - 1], &dst = layout[i];
+        const std::vector<texel> &src_texels = rows.back();
+        std::vector<texel> dst_texels(static_cast<size_t>(dst.width) * dst.height);
+        for (int y = 0; y < dst.height; ++y)
+        {
+            const downsample_taps ty = get_downsample_taps(y, src.height, dst.height);
+            for (int x = 0; x < dst.width; ++x)
+            {
+                const downsample_taps tx = get_downsample_taps(x, src.width, dst.width);
+                // 偶数边长时权重都是 2 的幂，累加结果精确，四舍五入后等于 (a + b + c + d + 2) / 4
+                float r = 0.f, g = 0.f, b = 0.f;
+                for (int j = 0; j < ty.count; ++j)
+                    for (int i = 0; i < tx.count; ++i)
+                    {
+                        const float w = ty.weight[j] * tx.weight[i];
+                        const texel &t = src_texels[static_cast<size_t>(ty.index[j]) * src.width + tx.index[i]];
+                        r += w * t.r;
+                        g += w * t.g;
+                        b += w * t.b;
+                    }
+                dst_texels[static_cast<size_t>(y) * dst.width + x] = {
+                    static_cast<uint8_t>(std::min(r + 0.5f, 255.f)),
+                    static_cast<uint8_t>(std::min(g + 0.5f, 255.f)),
+                    static_cast<uint8_t>(std::min(b + 0.5f, 255.f)), 0};
+            }
+        }
+        rows.push_back(std::move(dst_texels));
+    }
+
+    // 再把每一级重排成 32x32 分块、块内 Morton 序，所有层级依次放进同一块对齐内存
+    auto tiled = std::make_shared<texel_storage>(layout);
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const mip_level &level = tiled->levels[i];
+        for (int y = 0; y < level.height; ++y)
+            for (int x = 0; x < level.width; ++x)
+                tiled->texels[texel_index(level, x, y)] = rows[i][static_cast<size_t>(y) * level.width + x];
+    }
+    storage = std::move(tiled);
+}
+
+void Texture::build_height_gradients(const texel_storage &color)
+{
+    // 高度取原图纹素 RGB 的模长（与原先凹凸着色器的定义相同），各级高度与颜色 mipmap 一样由上一级滤波得到，
+    // 不用颜色 mipmap 的模长，避免颜色先平均再取模带来的偏差
+    const std::vector<mip_level> &layout = color.levels;
+    std::vector<float> heights(static_cast<size_t>(width) * height), next;
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            const texel &t = color.texels[texel_index(layout[0], x, y)];
+            heights[static_cast<size_t>(y) * width + x] = std::sqrt(static_cast<float>(t.r * t.r + t.g * t.g + t.b * t.b));
+        }
+
+    auto tiled = std::make_shared<gradient_storage>(layout);
+    for (size_t i = 0; i < layout.size(); ++i)
+    {
+        const mip_level &level = layout[i];
+        if (i > 0)
+        {
+            const mip_level &src = layout[i - 1];
+            next.assign(static_cast<size_t>(level.width) * level.height, 0.f);
+            for (int y = 0; y < level.height; ++y)
+            {
+                const downsample_taps ty = get_downsample_taps(y, src.height, level.height);
+                for (int x = 0; x < level.width; ++x)
+                {
+                    const downsample_taps tx = get_downsample_taps(x, src.width, level.width);
+                    float sum = 0.f;
+                    for (int j = 0; j < ty.count; ++j)
+                        for (int i = 0; i < tx.count; ++i)
+                            sum += ty.weight[j] * tx.weight[i] * heights[static_cast<size_t>(ty.index[j]) * src.width + tx.index[i]];
+                    next[static_cast<size_t>(y) * level.width + x] = sum;
+                }
+            }
+            heights.swap(next);
+        }
+
+        // u 方向取右侧纹素，v 方向取上一行（v 增大时图像行号减小），边缘处差分为 0；
+        // 第 i 级一个纹素跨过原图的多个纹素，乘以宽高之比换算回原图一个纹素上的高度差，各级的梯度大小一致
+        const float scale_u = static_cast<float>(level.width) / width;
+        const float scale_v = static_cast<float>(level.height) / height;
+        for (int y = 0; y < level.height; ++y)
+            for (int x = 0; x < level.width; ++x)
+            {
+                float h = heights[static_cast<size_t>(y) * level.width + x];
+                float h_u = heights[static_cast<size_t>(y) * level.width + std::min(x + 1, level.width - 1)];
+                float h_v = heights[static_cast<size_t>(std::max(y - 1, 0)) * level.width + x];
+                tiled->texels[texel_index(level, x, y)] = {(h_u - h) * scale_u, (h_v - h) * scale_v};
+            }
+    }
+    gradients = std::move(tiled);
+}
@@ -1,33 +1,257 @@
 #pragma once
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
 #include <opencv2/opencv.hpp>
 #include "Vec.hpp"
 #include "Log.hpp"
 
+// 纹理的采样格式：同一个文件按不同格式加载得到不同的纹理
+enum class TextureFormat
+{
+    Color,          // RGB 颜色，带 mipmap
+    HeightGradient, // 高度图（取 RGB 的模长为高度）沿 u、v 方向的差分，每级 mipmap 各自预先求好，供凹凸/位移贴图使用
+};
+
 class Texture{
+public:
+    // 纹素：RGB 各 8 位，补齐到 4 字节
+    struct texel
+    {
+        uint8_t r, g, b, pad;
+    };
+    // 双线性过滤所需的 2x2 纹素：t00 在左上，t10 在其右侧，t01 在其下方；s、t 为 x、y 方向 1/256 精度的权重
+    struct texel_quad
+    {
+        texel t00, t10, t01, t11;
+        int s, t;
+    };
+    // 高度梯度：当前纹素与 u 方向（右侧）、v 方向（上方）相邻纹素的高度差，单位统一换算到原图的一个纹素
+    struct gradient
+    {
+        float du, dv;
+    };
+
 private:
-    cv::Mat image_data;
+    // 纹素按 32x32 的分块（4KB，正好一个内存页）存放，分块按行排列，块内按 Morton（Z 序）排列：
+    // 任意对齐的 4x4 块（64 字节，一条缓存行）、8x8 块都是连续的，且这些小块之间也按 Z 序排列，
+    // 沿横向、纵向或斜向采样时相邻纹素大多落在同一缓存行和同一内存页；不足 32 的边缘按整块补齐
+    static constexpr int tile_bits = 5;
+    static constexpr int tile_size = 1 << tile_bits;
+    static constexpr int tile_texels = tile_size * tile_size;
+    // 块内坐标 0~31 的比特交错表：morton = morton_bits[x] | morton_bits[y] << 1
+    static constexpr std::array<uint16_t, tile_size> morton_bits = []
+    {
+        std::array<uint16_t, tile_size> bits{};
+        for (int i = 0; i < tile_size; ++i)
+            for (int b = 0; b < tile_bits; ++b)
+                bits[i] |= ((i >> b) & 1) << (2 * b);
+        return bits;
+    }();
+    struct mip_level
+    {
+        int width, height;
+        int tiles_x;   // 每行的分块数
+        size_t offset; // 本级第一个纹素在 texels 中的下标
+    };
+    // 所有 mip 层级放在一块连续内存中，按分块大小对齐；颜色纹素的分块正好占一个内存页（4KB）
+    // 颜色与高度梯度共用同一套分块布局，只是每个纹素的类型不同
+    template <class T>
+    struct tiled_storage
+    {
+        std::vector<mip_level> levels; // levels[0] 为原图，之后每级长宽减半直到 1x1
+        T *texels = nullptr;
+        size_t texel_count = 0;
+
+        explicit tiled_storage(std::vector<mip_level> layout);
+        ~tiled_storage();
+        tiled_storage(const tiled_storage &) = delete;
+        tiled_storage &operator=(const tiled_storage &) = delete;
+    };
+    using texel_storage = tiled_storage<texel>;
+    using gradient_storage = tiled_storage<gradient>;
+
+    // 与 cv::Mat 一样按引用共享，拷贝 Texture（如设置材质）不复制纹素
+    // Color 格式只有 storage，HeightGradient 格式只有 gradients
+    std::shared_ptr<const texel_storage> storage;
+    std::shared_ptr<const gradient_storage> gradients;
+    std::string path;
+    TextureFormat format = TextureFormat::Color;
     int width, height;
     bool valid = false;
 
+    // 每级的宽高（盒式滤波逐级减半）与在分块存储中的偏移
+    static std::vector<mip_level> mip_layout(int width, int height);
+    void build_mipmaps(const cv::Mat &image);
+    void build_height_gradients(const texel_storage &color);
+
+    // (x, y) 处纹素的下标，没有分支
+    static size_t texel_index(const mip_level &level, int x, int y)
+    {
+        size_t tile = static_cast<size_t>(y >> tile_bits) * level.tiles_x + (x >> tile_bits);
+        unsigned morton = morton_bits[x & (tile_size - 1)] | (morton_bits[y & (tile_size - 1)] << 1);
+        return level.offset + tile * tile_texels + morton;
+    }
+    const texel &fetch(const mip_level &level, int x, int y) const { return storage->texels[texel_index(level, x, y)]; }
+    const mip_level &level_at(int level) const
+    {
+        const auto &levels = storage ? storage->levels : gradients->levels;
+        return levels[std::clamp(level, 0, static_cast<int>(levels.size()) - 1)];
+    }
+    texel_quad gather(const mip_level &level, float u, float v) const;
+    // 在 level 上双线性采样，结果乘以 weight 累加到 rgb
+    void accumulate_bilinear(const mip_level &level, float u, float v, float weight, float rgb[3]) const;
+    static float fast_log2(float x);
+
 public:
     Texture() = default;
-    Texture(const std::string& name)
+    Texture(const std::string& name) : path(name)
     {
-        image_data = cv::imread(name);
+        cv::Mat image_data = cv::imread(name);
         if (image_data.empty())
         {
-            LOGE("Failed to load texture: %s", name.c_str());
+            LOGE("Failed to load texture: {}", name);
             throw std::runtime_error("Failed to load texture");
         }
         cv::cvtColor(image_data, image_data, cv::COLOR_RGB2BGR);
         width = image_data.cols;
         height = image_data.rows;
+        build_mipmaps(image_data); // 加载时一次性生成分块存放的 mipmap，之后不再保留 cv::Mat
         valid = true;
     }
+    // 由已加载的颜色纹理生成其他格式（如 HeightGradient），不再重新解码图片
+    Texture(const Texture &source, TextureFormat format);
 
+    const std::string &getPath() const { return path; }
+    TextureFormat getFormat() const { return format; }
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    int getLevelCount() const
+    {
+        return storage ? static_cast<int>(storage->levels.size()) : gradients ? static_cast<int>(gradients->levels.size()) : 0;
+    }
+    // 全部 mip 层级占用的字节数
+    size_t getMemoryBytes() const
+    {
+        return (storage ? storage->texel_count * sizeof(texel) : 0) + (gradients ? gradients->texel_count * sizeof(gradient) : 0);
+    }
     bool isvalid() const { return valid; }
 
-    Vec3f getColor(float u, float v);
+    // 最近点采样原图
+    Vec3f getColor(float u, float v) const;
+    // 取出第 level 级 mipmap 上 (u, v) 处双线性过滤需要的 4 个纹素及权重
+    texel_quad gather(float u, float v, int level = 0) const;
+    // 在第 level 级 mipmap 上做双线性采样
+    Vec3f getColorBilinear(float u, float v, int level = 0) const;
+    // 在相邻两级 mipmap 上各做双线性采样再按 lod 的小数部分混合（三线性）
+    Vec3f getColorTrilinear(float u, float v, float lod) const;
+    // HeightGradient 格式：在最接近 lod 的一级 mipmap 上最近点取出高度梯度，一次访存
+    gradient getGradient(float u, float v, float lod = 0.f) const;
+
+    // 由纹理坐标沿屏幕 x、y 方向每像素的变化量求 mipmap 层级：一个像素覆盖的纹素跨度取 log2
+    float getLod(const Vec2f &duv_dx, const Vec2f &duv_dy) const;
 };
+
+// 采样函数位于着色器的内层循环，定义在头文件中以便内联
+inline Vec3f Texture::getColor(float u, float v) const
+{
+    u = std::clamp(u, 0.0f, 1.0f);
+    v = std::clamp(v, 0.0f, 1.0f);
+    
+    auto u_img = static_cast<int>(u * (width - 1));
+    auto v_img = static_cast<int>((1 - v) * (height - 1));
+
+    const texel &t = fetch(storage->levels[0], u_img, v_img);
+    return Vec3f{static_cast<float>(t.r), static_cast<float>(t.g), static_cast<float>(t.b)};
+}
+
+inline Texture::texel_quad Texture::gather(const mip_level &level, float u, float v) const
+{
+    // 纹素中心位于 (i + 0.5) / width，超出边缘的纹素取边缘值；clamp/min/max 都编译成无分支指令
+    float x = std::clamp(u, 0.0f, 1.0f) * level.width - 0.5f;
+    float y = (1 - std::clamp(v, 0.0f, 1.0f)) * level.height - 0.5f;
+    int ix = static_cast<int>(x + 1.f) - 1; // x >= -0.5，加 1 后截断即向下取整
+    int iy = static_cast<int>(y + 1.f) - 1;
+    int x0 = std::max(ix, 0), x1 = std::min(ix + 1, level.width - 1);
+    int y0 = std::max(iy, 0), y1 = std::min(iy + 1, level.height - 1);
+
+    // 双线性权重量化到 1/256（与硬件纹理过滤的精度相当）
+    return {fetch(level, x0, y0), fetch(level, x1, y0), fetch(level, x0, y1), fetch(level, x1, y1),
+            static_cast<int>((x - ix) * 256.f), static_cast<int>((y - iy) * 256.f)};
+}
+
+inline Texture::texel_quad Texture::gather(float u, float v, int level) const
+{
+    return gather(level_at(level), u, v);
+}
+
+inline void Texture::accumulate_bilinear(const mip_level &level, float u, float v, float weight, float rgb[3]) const
+{
+    // 纹素在整数域中混合，最后只转换一次浮点
+    const texel_quad q = gather(level, u, v);
+    const int s = q.s, t = q.t;
+    int r = (q.t00.r * (256 - s) + q.t10.r * s) * (256 - t) + (q.t01.r * (256 - s) + q.t11.r * s) * t;
+    int g = (q.t00.g * (256 - s) + q.t10.g * s) * (256 - t) + (q.t01.g * (256 - s) + q.t11.g * s) * t;
+    int b = (q.t00.b * (256 - s) + q.t10.b * s) * (256 - t) + (q.t01.b * (256 - s) + q.t11.b * s) * t;
+    weight *= 1.f / 65536.f;
+    rgb[0] += static_cast<float>(r) * weight;
+    rgb[1] += static_cast<float>(g) * weight;
+    rgb[2] += static_cast<float>(b) * weight;
+}
+
+inline Vec3f Texture::getColorBilinear(float u, float v, int level) const
+{
+    float rgb[3] = {0.f, 0.f, 0.f};
+    accumulate_bilinear(level_at(level), u, v, 1.f, rgb);
+    return Vec3f{rgb[0], rgb[1], rgb[2]};
+}
+
+inline Vec3f Texture::getColorTrilinear(float u, float v, float lod) const
+{
+    // 放大时只用原图
+    lod = std::clamp(lod, 0.0f, static_cast<float>(getLevelCount() - 1));
+    int level = static_cast<int>(lod);
+    float t = lod - level;
+
+    float rgb[3] = {0.f, 0.f, 0.f};
+    accumulate_bilinear(storage->levels[level], u, v, 1 - t, rgb);
+    if (t > 0.f)
+        accumulate_bilinear(storage->levels[level + 1], u, v, t, rgb);
+    return Vec3f{rgb[0], rgb[1], rgb[2]};
+}
+
+inline Texture::gradient Texture::getGradient(float u, float v, float lod) const
+{
+    // 与 getColor 相同的最近点取整方式；梯度表总是取右侧、上方相邻纹素的差，
+    // 只是近似原先逐片元的差分（原先按 1/w 偏移后再取整，有时会落在同一个纹素上）
+    const mip_level &level = level_at(static_cast<int>(lod + 0.5f));
+    u = std::clamp(u, 0.0f, 1.0f);
+    v = std::clamp(v, 0.0f, 1.0f);
+    auto u_img = static_cast<int>(u * (level.width - 1));
+    auto v_img = static_cast<int>((1 - v) * (level.height - 1));
+    return gradients->texels[texel_index(level, u_img, v_img)];
+}
+
+// 近似 log2：浮点数的指数部分加上尾数的线性近似，误差小于 0.09，选择 mipmap 层级足够
+inline float Texture::fast_log2(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float exponent = static_cast<float>(static_cast<int>(bits >> 23) - 127);
+    bits = (bits & 0x007fffffu) | 0x3f800000u; // 尾数，[1, 2)
+    float mantissa;
+    std::memcpy(&mantissa, &bits, sizeof(mantissa));
+    return exponent + (mantissa - 1.f);
+}
+
+inline float Texture::getLod(const Vec2f &duv_dx, const Vec2f &duv_dy) const
+{
+    // 换算成原图上的纹素跨度，取两个方向中较大的一个（与 GPU 的各向同性 mipmap 选择一致）
+    float dx_u = duv_dx.x * width, dx_v = duv_dx.y * height;
+    float dy_u = duv_dy.x * width, dy_v = duv_dy.y * height;
+    float rho2 = std::max(dx_u * dx_u + dx_v * dx_v, dy_u * dy_u + dy_v * dy_v);
+    if (!(rho2 > 1.f))
+        return 0.f;
+    return 0.5f * fast_log2(rho2);
+}
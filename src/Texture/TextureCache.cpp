@@ -0,0 +1,70 @@
+#include "TextureCache.h"
+#include <filesystem>
+
+std::shared_ptr<const Texture> TextureCache::load(const std::string &path, TextureFormat format)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return load_locked(path, format);
+}
+
+std::shared_ptr<const Texture> TextureCache::load_locked(const std::string &path, TextureFormat format)
+{
+    Key alias{path, format};
+    if (auto it = aliases.find(alias); it != aliases.end())
+    {
+        ++hits;
+        return it->second;
+    }
+
+    // 不同写法的路径（相对路径、..、符号链接）指向同一个文件时共用一份纹理；无法规范化时退回原始路径
+    std::error_code error;
+    auto canonical = std::filesystem::weakly_canonical(path, error);
+    Key key{error ? path : canonical.string(), format};
+    if (auto it = textures.find(key); it != textures.end())
+    {
+        ++hits;
+        aliases.emplace(std::move(alias), it->second);
+        return it->second;
+    }
+
+    ++misses;
+    auto texture = format == TextureFormat::Color ? std::make_shared<const Texture>(path)
+                                                  : std::make_shared<const Texture>(*load_locked(path, TextureFormat::Color), format);
+    resident_bytes += texture->getMemoryBytes();
+    textures.emplace(std::move(key), texture);
+    aliases.emplace(std::move(alias), texture);
+    LOGI("texture loaded: {} ({} x {}, {} KB)", path, texture->getWidth(), texture->getHeight(), texture->getMemoryBytes() / 1024);
+    return texture;
+}
+
+void TextureCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    textures.clear();
+    aliases.clear();
+    resident_bytes = 0;
+}
+
+size_t TextureCache::get_resident_bytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return resident_bytes;
+}
+
+size_t TextureCache::get_hits() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+size_t TextureCache::get_misses() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
+
+size_t TextureCache::get_texture_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return textures.size();
+}
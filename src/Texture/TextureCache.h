@@ -0,0 +1,55 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Texture.h"
+
+// 进程内共享的纹理缓存：按规范化后的路径和采样格式去重，同一张图片只解码、存储一次
+// 返回的纹理句柄不可修改，材质之间共享同一份纹素；缓存命中只需一次哈希查找
+class TextureCache
+{
+public:
+    static TextureCache &get_instance()
+    {
+        static TextureCache instance;
+        return instance;
+    }
+
+    TextureCache(const TextureCache &) = delete;
+    TextureCache &operator=(const TextureCache &) = delete;
+
+    // 加载纹理，已缓存时直接返回；文件无法读取时与 Texture 构造函数一样抛出异常
+    // Color 以外的格式由同一路径的 Color 纹理转换得到，图片只解码一次
+    std::shared_ptr<const Texture> load(const std::string &path, TextureFormat format = TextureFormat::Color);
+    // 清空缓存；已经取得的句柄仍然有效，直到最后一个引用释放
+    void clear();
+
+    size_t get_resident_bytes() const; // 缓存中全部纹理（含 mipmap）占用的字节数
+    size_t get_hits() const;
+    size_t get_misses() const;
+    size_t get_texture_count() const;
+
+private:
+    TextureCache() = default;
+
+    std::shared_ptr<const Texture> load_locked(const std::string &path, TextureFormat format);
+
+    struct Key
+    {
+        std::string path;
+        TextureFormat format;
+        bool operator==(const Key &other) const { return path == other.path && format == other.format; }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key &key) const { return std::hash<std::string>{}(key.path) * 31 + static_cast<size_t>(key.format); }
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<Key, std::shared_ptr<const Texture>, KeyHash> textures; // 以规范化路径为键
+    std::unordered_map<Key, std::shared_ptr<const Texture>, KeyHash> aliases;  // 以调用者传入的原始路径为键，命中时不必访问文件系统
+    size_t resident_bytes = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+};
@@ -0,0 +1,224 @@
+﻿#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 常驻的任务窃取（work-stealing）线程池：
+// 每个线程拥有一个自己的双端队列，自己从队尾压入/取出任务（后进先出，缓存友好），
+// 空闲线程从其他线程的队首窃取任务（先进先出，偷到的是最大的一块工作）。
+// 线程在构造时创建一次，之后每帧只提交任务，不再创建线程，也没有全局任务锁。
+class JobSystem
+{
+public:
+    // 一组任务，wait 时等待组内全部任务完成
+    class TaskGroup
+    {
+        friend class JobSystem;
+        std::atomic<size_t> pending = 0;
+    };
+
+    explicit JobSystem(size_t threads);
+    ~JobSystem();
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    // 参与计算的线程数（后台线程 + 调用 wait 的线程）
+    size_t thread_count() const { return workers.size() + 1; }
+
+    // 向任务组提交一个任务
+    void run(TaskGroup &group, std::function<void()> task);
+
+    // 等待任务组完成；等待期间调用线程也会执行队列中的任务，而不是阻塞
+    void wait(TaskGroup &group);
+
+    // 将 [begin, end) 二分切成不大于 grain 的区间，并行调用 body(range_begin, range_end)
+    // 切下来的一半作为可被窃取的任务，另一半当前线程继续切分，直到区间足够小再执行
+    template <class F>
+    void parallel_for(size_t begin, size_t end, size_t grain, const F &body);
+
+private:
+    struct Job
+    {
+        std::function<void()> task;
+        TaskGroup *group;
+    };
+
+    // 每个线程一个队列；队列的锁只在本线程与窃取者之间竞争
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // queues[0] 给外部线程使用，queues[i + 1] 属于 workers[i]
+
+    std::atomic<size_t> queued = 0;   // 所有队列中尚未被取走的任务数
+    std::atomic<size_t> sleeping = 0; // 正在休眠的后台线程数
+    std::mutex sleep_mutex;
+    std::condition_variable wake;
+    bool stop = false;
+
+    // 当前线程在哪个 JobSystem 中、使用哪个队列
+    static inline thread_local const JobSystem *current_system = nullptr;
+    static inline thread_local size_t current_index = 0;
+
+    size_t queue_index() const { return current_system == this ? current_index : 0; }
+    void push(Job job);
+    bool try_pop(Job &job);
+    void execute(Job &job);
+    void worker_loop(size_t index);
+
+    template <class F>
+    void split_range(TaskGroup &group, size_t begin, size_t end, size_t grain, const F &body);
+};
+
+inline JobSystem::JobSystem(size_t threads)
+{
+    queues.reserve(threads + 1);
+    for (size_t i = 0; i < threads + 1; ++i)
+        queues.push_back(std::make_unique<WorkQueue>());
+
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; ++i)
+        workers.emplace_back([this, i] { worker_loop(i + 1); });
+}
+
+inline JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+inline void JobSystem::run(TaskGroup &group, std::function<void()> task)
+{
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+    push({std::move(task), &group});
+}
+
+inline void JobSystem::wait(TaskGroup &group)
+{
+    Job job;
+    while (group.pending.load(std::memory_order_acquire) != 0)
+    {
+        if (try_pop(job))
+            execute(job);
+        else
+            std::this_thread::yield(); // 剩下的任务都在别的线程手里，等它们做完
+    }
+}
+
+template <class F>
+void JobSystem::parallel_for(size_t begin, size_t end, size_t grain, const F &body)
+{
+    if (begin >= end)
+        return;
+
+    TaskGroup group;
+    split_range(group, begin, end, std::max<size_t>(grain, 1), body);
+    wait(group);
+}
+
+template <class F>
+void JobSystem::split_range(TaskGroup &group, size_t begin, size_t end, size_t grain, const F &body)
+{
+    while (end - begin > grain)
+    {
+        size_t mid = begin + (end - begin) / 2;
+        run(group, [this, &group, mid, end, grain, &body] { split_range(group, mid, end, grain, body); });
+        end = mid;
+    }
+    body(begin, end);
+}
+
+inline void JobSystem::push(Job job)
+{
+    auto &queue = *queues[queue_index()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    queued.fetch_add(1);
+
+    // 只有存在休眠线程时才需要加锁唤醒
+    if (sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        wake.notify_one();
+    }
+}
+
+inline bool JobSystem::try_pop(Job &job)
+{
+    const size_t self = queue_index();
+    const size_t count = queues.size();
+
+    // 先取自己队尾的任务，再依次从其他队列的队首窃取
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto &queue = *queues[(self + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            continue;
+
+        if (i == 0)
+        {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        else
+        {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+inline void JobSystem::execute(Job &job)
+{
+    job.task();
+    job.task = nullptr;
+    job.group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+inline void JobSystem::worker_loop(size_t index)
+{
+    current_system = this;
+    current_index = index;
+
+    Job job;
+    while (true)
+    {
+        if (try_pop(job))
+        {
+            execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleeping.fetch_add(1);
+        wake.wait(lock, [this] { return stop || queued.load() > 0; });
+        sleeping.fetch_sub(1);
+        if (stop)
+            return;
+    }
+}
+
+#endif
@@ -1,5 +1,6 @@
 ﻿#include "OBJ_Loader.h"
 #include "Materials.hpp"
+#include "MeshSimplify.h"
 #include "OrbitCamera.hpp"
 #include "Shader.h"
 
@@ -21,19 +22,17 @@ int main(int argc, char **argv)
         model_head.Load(obj_path + "/african_head/african_head.obj");
     }
 
-    auto triangles = objl::LoadTriangleList(model_triangle);
-    auto cow_TriangleList = objl::LoadTriangleList(model_cow);
-    auto body_TriangleList = objl::LoadTriangleList(model_body);
-    auto monster_TriangleList = objl::LoadTriangleList(model_monster);
-    auto head_TriangleList = objl::LoadTriangleList(model_head);
-
     // 创建材质 Material 对象
     Material blackheadMaterial = Materials::SkinMaterial(obj_path + "/Texture/diffuse.jpg");
     Material whiteheadMaterial = Materials::SkinMaterial(obj_path + "/boggie/head_diffuse.jpg");
     Material bodyMaterial = Materials::SkinMaterial(obj_path + "/boggie/body_diffuse.jpg");
     Material monsterMaterial = Materials::SkinMaterial(obj_path + "/diablo3_pose/diablo3_pose_diffuse.jpg");
     Material cowMaterial = Materials::cowMaterial(obj_path + "/cow/spot_texture.png");
-    cowMaterial.map_bump = Texture(obj_path + "/cow/hmap.jpg");
+    cowMaterial.map_bump = TextureCache::get_instance().load(obj_path + "/cow/hmap.jpg");
+    blackheadMaterial.map_normal = TextureCache::get_instance().load(obj_path + "/Texture/Normal.jpg"); // african_head_nm_tangent.tga 转存的 jpg
+    auto &texture_cache = TextureCache::get_instance();
+    LOGI("texture cache: {} textures, {} KB resident, {} hits, {} misses", texture_cache.get_texture_count(),
+         texture_cache.get_resident_bytes() / 1024, texture_cache.get_hits(), texture_cache.get_misses());
 
     constexpr const int width = 700;
     constexpr const int height = 700;
@@ -45,15 +44,34 @@ int main(int argc, char **argv)
     auto obj_pos = Vec3f{0.f, 0.f, -4.f};
 
     std::vector<MeshTriangle> objects = {
-        MeshTriangle(triangles, Material()),
-        MeshTriangle(cow_TriangleList, cowMaterial),
-        MeshTriangle(body_TriangleList, bodyMaterial),
-        MeshTriangle(monster_TriangleList, monsterMaterial),
-        MeshTriangle(head_TriangleList, blackheadMaterial)};
+        MeshTriangle(model_triangle.LoadedMesh, Material()),
+        MeshTriangle(model_cow.LoadedMesh, cowMaterial),
+        MeshTriangle(model_body.LoadedMesh, bodyMaterial),
+        MeshTriangle(model_monster.LoadedMesh, monsterMaterial),
+        MeshTriangle(model_head.LoadedMesh, blackheadMaterial)};
+    // 为每个模型生成简化的 LOD 链，绘制时按屏幕上的大小选择级别
+    for (auto &object : objects)
+        object.lods = objl::build_lod_chain(object.mesh);
+
+    // 实例化演示：同一个模型按 10x10 排布画 100 次，所有实例共用一份网格数据
+    std::vector<Matrix4f> instance_grid;
+    for (int i = 0; i < 10; ++i)
+        for (int j = 0; j < 10; ++j)
+            instance_grid.push_back(model_matrix({(i - 4.5f) * 2.5f, 0.f, -j * 2.5f}, {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f}));
+    bool instanced = false;
+
+    // 把第 index 个模型放进场景（物体只引用网格，不复制网格数据）
+    auto show_object = [&](size_t index)
+    {
+        auto object = std::make_unique<MeshTriangle>(objects[index]);
+        if (instanced)
+            object->instances = instance_grid;
+        scene.set_obj(std::move(object));
+    };
 
     // 当前渲染物体的索引
     size_t current_obj_index = 0;
-    scene.set_obj(std::make_unique<MeshTriangle>(objects[current_obj_index]));
+    show_object(current_obj_index);
     scene.add(std::make_unique<Light>(l1));
     scene.add(std::make_unique<Light>(l2));
     scene.set_amb_light_intensity({1, 1, 1});
@@ -68,16 +86,17 @@ int main(int argc, char **argv)
     ras.set_scene(scene);
 
     // 设置顶点着色器
-    ras.set_vertex_shader(vertex_shader);
-
-    // 定义片着色器类型数组
-    std::vector<rst::PixelShader> shaders = {
-        normal_fragment_shader,
-        white_fragment_shader,
-        phong_fragment_shader,
-        texture_fragment_shader,
-        bump_fragment_shader,
-        displacement_fragment_shader};
+    ras.set_vertex_shader(rst::rasterizer::vertex_pipeline<vertex_shader>());
+
+    // 定义片着色器数组（每个着色器对应一条预先实例化的管线）
+    std::vector<rst::rasterizer::FragmentPipeline> shaders = {
+        rst::rasterizer::fragment_pipeline<normal_fragment_shader>(),
+        rst::rasterizer::fragment_pipeline<white_fragment_shader>(),
+        rst::rasterizer::fragment_pipeline<phong_fragment_shader>(),
+        rst::rasterizer::fragment_pipeline<texture_fragment_shader>(),
+        rst::rasterizer::fragment_pipeline<bump_fragment_shader>(),
+        rst::rasterizer::fragment_pipeline<displacement_fragment_shader>(),
+        rst::rasterizer::fragment_pipeline<normal_map_fragment_shader>()};
 
     // 当前片着色器的索引
     size_t current_shader_index = 0; // 默认使用 normal_fragment_shader
@@ -133,6 +152,16 @@ int main(int argc, char **argv)
         case 'a':
             ras.switch_anti_Aliasing();
             break;
+        case 's': // 在 1/2/4/8 之间循环切换 msaa 采样数
+            ras.set_sample_count(ras.get_sample_count() == 8 ? 1 : ras.get_sample_count() * 2);
+            break;
+        case 'l':
+            ras.switch_lod();
+            break;
+        case 'i':
+            instanced = !instanced;
+            show_object(current_obj_index);
+            break;
         case 'p':
             cv::waitKey();
             break;
@@ -146,11 +175,11 @@ int main(int argc, char **argv)
             break;
         case Direction::LEFT: // 方向键左
             current_obj_index = (current_obj_index - 1 + objects.size()) % objects.size();
-            scene.set_obj(std::make_unique<MeshTriangle>(objects[current_obj_index]));
+            show_object(current_obj_index);
             break;
         case Direction::RIGHT: // 方向键右
             current_obj_index = (current_obj_index + 1) % objects.size();
-            scene.set_obj(std::make_unique<MeshTriangle>(objects[current_obj_index]));
+            show_object(current_obj_index);
             break;
         default:
             break;
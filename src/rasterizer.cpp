@@ -1,87 +1,122 @@
 ﻿#include "rasterizer.h"
 
-rst::rasterizer::rasterizer(int w, int h, const std::string &format) : width(w), height(h), pixel_Mutex(w * h)
+rst::rasterizer::rasterizer(int w, int h, const std::string &format) : width(w), height(h)
 {
     image = std::make_unique<Image>(w, h, format);
-    depth_buf.resize(w * h, -std::numeric_limits<float>::infinity()); // 初始化为负无穷大
-    back_buf.resize(w * h, 0.f);
+    tiles_x = (w + tile_size - 1) / tile_size;
+    tiles_y = (h + tile_size - 1) / tile_size;
+    tile_bins.resize(tiles_x * tiles_y);
+    tile_color_epoch.resize(tiles_x * tiles_y, 0);
+    tile_depth_epoch.resize(tiles_x * tiles_y, 0);
+    back_tile_blank.resize(tiles_x * tiles_y, true);
+    front_tile_blank.resize(tiles_x * tiles_y, true);
+    hiz_width = (w + hiz_tile_size - 1) / hiz_tile_size;
+    hiz_height = (h + hiz_tile_size - 1) / hiz_tile_size;
+
+    set_sample_count(sample_count); // 同时按初始模式分配缓冲区
+}
 
-    super_depth_buf.resize(w * h * samples * samples, -std::numeric_limits<float>::infinity());
-    super_back_buf.resize(w * h * samples * samples, 0.f);
+// 按需分配或释放一个缓冲区：需要时保证大小为 size，不需要时连同容量一起释放
+// 新分配的内容由分块清除负责初始化
+template <class T>
+static bool resize_attachment(std::vector<T> &buf, bool needed, size_t size)
+{
+    if (!needed)
+        size = 0;
+    if (buf.size() == size)
+        return false;
+
+    std::vector<T>().swap(buf);
+    buf.resize(size);
+    return true;
 }
 
-void rst::rasterizer::set_model(const Vec3f &translate, const Vec3f &rotate, const Vec3f &scale)
+void rst::rasterizer::update_attachments()
 {
-    // 将角度转换为弧度
-    float rx = static_cast<float>(rotate.x * MY_PI / 180.f);
-    float ry = static_cast<float>(rotate.y * MY_PI / 180.f);
-    float rz = static_cast<float>(rotate.z * MY_PI / 180.f);
-
-    // 计算三角函数值
-    float cos_x = cos(rx), sin_x = sin(rx);
-    float cos_y = cos(ry), sin_y = sin(ry);
-    float cos_z = cos(rz), sin_z = sin(rz);
-
-    // 计算组合变换矩阵的元素
-    float m11 = cos_y * cos_z * scale.x;
-    float m12 = (sin_x * sin_y * cos_z - cos_x * sin_z) * scale.y;
-    float m13 = (cos_x * sin_y * cos_z + sin_x * sin_z) * scale.z;
-    float m14 = translate.x;
-
-    float m21 = cos_y * sin_z * scale.x;
-    float m22 = (sin_x * sin_y * sin_z + cos_x * cos_z) * scale.y;
-    float m23 = (cos_x * sin_y * sin_z - sin_x * cos_z) * scale.z;
-    float m24 = translate.y;
-
-    float m31 = -sin_y * scale.x;
-    float m32 = sin_x * cos_y * scale.y;
-    float m33 = cos_x * cos_y * scale.z;
-    float m34 = translate.z;
-
-    // 构建最终的组合变换矩阵
-    vertex_payload.model = Matrix4f{
-        m11, m12, m13, m14,
-        m21, m22, m23, m24,
-        m31, m32, m33, m34,
-        0, 0, 0, 1};
+    const size_t pixels = static_cast<size_t>(width) * height;
+    const bool face = renderMode == FACE;
+
+    bool changed = false;
+    changed |= resize_attachment(back_buf, true, pixels);
+    changed |= resize_attachment(depth_buf, face && !anti_Aliasing, pixels);
+    changed |= resize_attachment(hiz_min, face, static_cast<size_t>(hiz_width) * hiz_height);
+    changed |= resize_attachment(hiz_max, face, static_cast<size_t>(hiz_width) * hiz_height);
+    changed |= resize_attachment(sample_depth_buf, face && anti_Aliasing, pixels * sample_count);
+    changed |= resize_attachment(sample_color_buf, face && anti_Aliasing, pixels * sample_count);
+    if (!changed)
+        return;
 
-    // // 绕 X 轴旋转
-    // Matrix4f rotate_x{
-    //     1, 0, 0, 0,
-    //     0, cos(rx), -sin(rx), 0,
-    //     0, sin(rx), cos(rx), 0,
-    //     0, 0, 0, 1};
-
-    // // 绕 Y 轴旋转
-    // Matrix4f rotate_y{
-    //     cos(ry), 0, sin(ry), 0,
-    //     0, 1, 0, 0,
-    //     -sin(ry), 0, cos(ry), 0,
-    //     0, 0, 0, 1};
-
-    // // 绕 Z 轴旋转
-    // Matrix4f rotate_z{
-    //     cos(rz), -sin(rz), 0, 0,
-    //     sin(rz), cos(rz), 0, 0,
-    //     0, 0, 1, 0,
-    //     0, 0, 0, 1};
-
-    // // 缩放矩阵
-    // Matrix4f scale_mat{
-    //     scale.x, 0, 0, 0,
-    //     0, scale.y, 0, 0,
-    //     0, 0, scale.z, 0,
-    //     0, 0, 0, 1};
-
-    // // 平移矩阵
-    // Matrix4f translate_mat{
-    //     1, 0, 0, translate.x,
-    //     0, 1, 0, translate.y,
-    //     0, 0, 1, translate.z,
-    //     0, 0, 0, 1};
-
-    // // 组合变换：先缩放，再旋转，最后平移
-    // vertex_payload.model = translate_mat * rotate_z * rotate_y * rotate_x * scale_mat;
+    // 新缓冲区的内容未初始化，所有分块下次被触及时重新清除
+    std::fill(tile_color_epoch.begin(), tile_color_epoch.end(), 0);
+    std::fill(tile_depth_epoch.begin(), tile_depth_epoch.end(), 0);
+    LOGI("render target memory: {} KB", get_buffer_memory().total() / 1024);
+}
+
+rst::buffer_memory rst::rasterizer::get_buffer_memory() const
+{
+    buffer_memory memory;
+    memory.color = (back_buf.capacity() + image->get_frame_buf().capacity()) * sizeof(Vec3f);
+    memory.depth = (depth_buf.capacity() + hiz_min.capacity() + hiz_max.capacity()) * sizeof(float);
+    memory.sample_color = sample_color_buf.capacity() * sizeof(Vec3f);
+    memory.sample_depth = sample_depth_buf.capacity() * sizeof(float);
+    return memory;
+}
+
+void rst::rasterizer::set_sample_count(int count)
+{
+    // 标准多重采样位置（以 1/16 像素为单位，相对像素中心）
+    static const std::array<std::array<int, 2>, 1> pattern1 = {{{0, 0}}};
+    static const std::array<std::array<int, 2>, 2> pattern2 = {{{4, 4}, {-4, -4}}};
+    static const std::array<std::array<int, 2>, 4> pattern4 = {{{-2, -6}, {6, -2}, {-6, 2}, {2, 6}}};
+    static const std::array<std::array<int, 2>, 8> pattern8 = {{{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}}};
+
+    auto apply = [&](const auto &pattern)
+    {
+        sample_extent = 0;
+        for (size_t i = 0; i < pattern.size(); ++i)
+        {
+            sample_offsets[i] = Vec2i{pattern[i][0] * subpixel_one / 16, pattern[i][1] * subpixel_one / 16};
+            sample_extent = std::max({sample_extent, std::abs(sample_offsets[i].x), std::abs(sample_offsets[i].y)});
+        }
+    };
+
+    switch (count)
+    {
+    case 1: apply(pattern1); break;
+    case 2: apply(pattern2); break;
+    case 4: apply(pattern4); break;
+    case 8: apply(pattern8); break;
+    default:
+        LOGE("Unsupported msaa sample count: {}", count);
+        return;
+    }
+
+    sample_count = count;
+    update_attachments();
+}
+
+// 将 [x0, x1) x [y0, y1) 内每个像素的子采样颜色取平均，写入后缓冲区
+void rst::rasterizer::resolve_samples(int x0, int y0, int x1, int y1)
+{
+    const float scale = 1.f / (255.f * sample_count);
+    for (int y = y0; y < y1; ++y)
+    {
+        for (int x = x0; x < x1; ++x)
+        {
+            int ind = get_index(x, y);
+            const Vec3f *samples = &sample_color_buf[ind * sample_count];
+            Vec3f sum = samples[0];
+            for (int i = 1; i < sample_count; ++i)
+                sum += samples[i];
+            back_buf[ind] = sum * scale;
+        }
+    }
+}
+
+void rst::rasterizer::set_model(const Vec3f &translate, const Vec3f &rotate, const Vec3f &scale)
+{
+    // 整个场景共用的模型矩阵，每个物体再右乘自己的 transform
+    vertex_payload.model = model_matrix(translate, rotate, scale);
 }
 
 void rst::rasterizer::set_view(const Vec3f &eye_pos, const Vec3f &target_pos, const Vec3f &up_dir)
@@ -109,6 +144,9 @@ void rst::rasterizer::set_projection(float eye_fov, const float &aspect_ratio, c
     float tx = ty / aspect_ratio;    // 水平方向的缩放因子
     float zRange = zFar - zNear;     // 深度范围
 
+    clip_near = std::abs(zNear);
+    clip_far = std::abs(zFar);
+
     // 透视投影矩阵
     vertex_payload.projection = Matrix4f{
         tx, 0, 0, 0,
@@ -124,22 +162,103 @@ void rst::rasterizer::set_pixel(const Vec2i &point, const Vec3f &color)
     if (x < 0 || x >= width || y < 0 || y >= height)
         return;
 
+    int tile = (y / tile_size) * tiles_x + x / tile_size;
+    if (tile_color_epoch[tile] != color_epoch)
+        prepare_tile(tile);
+
     back_buf[get_index(x, y)] = color;
 }
 
+// 只推进清除编号，真正的清除推迟到分块第一次被触及时（prepare_tile）
 void rst::rasterizer::clearBuff(rst::Buffers buff)
 {
+    clear_bytes = 0;
     if ((buff & rst::Buffers::Color) == rst::Buffers::Color)
     {
-        std::fill(image->get_frame_buf().begin(), image->get_frame_buf().end(), Vec3f{0, 0, 0});
-        std::fill(back_buf.begin(), back_buf.end(), Vec3f{0, 0, 0});
-        std::fill(super_back_buf.begin(), super_back_buf.end(), Vec3f{0, 0, 0});
+        ++color_epoch;
         triangleCount = 0;
     }
     if ((buff & rst::Buffers::Depth) == rst::Buffers::Depth)
     {
-        std::fill(depth_buf.begin(), depth_buf.end(), -std::numeric_limits<float>::infinity());
-        std::fill(super_depth_buf.begin(), super_depth_buf.end(), -std::numeric_limits<float>::infinity());
+        ++depth_epoch;
+        hiz_rejected_tiles = 0;
+    }
+}
+
+void rst::rasterizer::tile_rect(int tile, int &x0, int &y0, int &x1, int &y1) const
+{
+    x0 = (tile % tiles_x) * tile_size;
+    y0 = (tile / tiles_x) * tile_size;
+    x1 = std::min(x0 + tile_size, width);
+    y1 = std::min(y0 + tile_size, height);
+}
+
+// 把分块内每个像素的 per_pixel 个元素填为 value，返回写入的字节数
+template <class T>
+size_t rst::rasterizer::fill_tile(std::vector<T> &buf, int tile, int per_pixel, const T &value)
+{
+    int x0, y0, x1, y1;
+    tile_rect(tile, x0, y0, x1, y1);
+    for (int y = y0; y < y1; ++y)
+    {
+        auto row = buf.begin() + static_cast<size_t>(get_index(x0, y)) * per_pixel;
+        std::fill(row, row + static_cast<size_t>(x1 - x0) * per_pixel, value);
+    }
+    return static_cast<size_t>(x1 - x0) * (y1 - y0) * per_pixel * sizeof(T);
+}
+
+// 分块在本帧第一次被触及：清除其中已过期的深度、颜色（以及开启时的子采样缓冲）
+// 分块多线程时每块只由一个线程处理，这里无需加锁
+void rst::rasterizer::prepare_tile(int tile)
+{
+    constexpr float far_depth = -std::numeric_limits<float>::infinity();
+    size_t bytes = 0;
+    if (tile_depth_epoch[tile] != depth_epoch)
+    {
+        tile_depth_epoch[tile] = depth_epoch;
+        if (!depth_buf.empty())
+            bytes += fill_tile(depth_buf, tile, 1, far_depth);
+        if (!sample_depth_buf.empty())
+            bytes += fill_tile(sample_depth_buf, tile, sample_count, far_depth);
+
+        if (!hiz_min.empty())
+        {
+            int x0, y0, x1, y1;
+            tile_rect(tile, x0, y0, x1, y1);
+            for (int by = y0 / hiz_tile_size; by < (y1 + hiz_tile_size - 1) / hiz_tile_size; ++by)
+            {
+                for (int bx = x0 / hiz_tile_size; bx < (x1 + hiz_tile_size - 1) / hiz_tile_size; ++bx)
+                {
+                    hiz_min[by * hiz_width + bx] = far_depth;
+                    hiz_max[by * hiz_width + bx] = far_depth;
+                }
+            }
+        }
+    }
+    if (tile_color_epoch[tile] != color_epoch)
+    {
+        tile_color_epoch[tile] = color_epoch;
+        if (!back_tile_blank[tile])
+            bytes += fill_tile(back_buf, tile, 1, Vec3f{0, 0, 0});
+        back_tile_blank[tile] = false;
+        if (!sample_color_buf.empty())
+            bytes += fill_tile(sample_color_buf, tile, sample_count, Vec3f{0, 0, 0});
+    }
+    if (bytes > 0)
+        clear_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// 准备 [x0, x1) x [y0, y1) 覆盖到的所有分块
+void rst::rasterizer::prepare_tiles(int x0, int y0, int x1, int y1)
+{
+    for (int ty = y0 / tile_size; ty <= (y1 - 1) / tile_size; ++ty)
+    {
+        for (int tx = x0 / tile_size; tx <= (x1 - 1) / tile_size; ++tx)
+        {
+            int tile = ty * tiles_x + tx;
+            if (tile_color_epoch[tile] != color_epoch || tile_depth_epoch[tile] != depth_epoch)
+                prepare_tile(tile);
+        }
     }
 }
 
@@ -175,13 +294,17 @@ void rst::rasterizer::show(std::string fps_str) const
 
     if (anti_Aliasing)
     {
-        cv::putText(cv_image, "SSAA anti_Aliasing active", cv::Point(10, 90), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 0, 0), 1);
+        cv::putText(cv_image, std::to_string(sample_count) + "x MSAA anti_Aliasing active", cv::Point(10, 90), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 0, 0), 1);
     }
     else
     {
         cv::putText(cv_image, "NO anti_Aliasing", cv::Point(10, 90), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 0, 0), 1);
     }
 
+    cv::putText(cv_image, "HiZ rejected tiles: " + std::to_string(hiz_rejected_tiles), cv::Point(10, 120), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 0), 1);
+    cv::putText(cv_image, "Clear bytes: " + std::to_string(clear_bytes / 1024) + " KB", cv::Point(10, 150), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 0), 1);
+    cv::putText(cv_image, "Culled objects: " + std::to_string(culled_objects), cv::Point(10, 180), cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(255, 255, 0), 1);
+
     // 创建窗口标题，显示三角形面数
     std::string windowTitle = "Render Window - Triangles: " + std::to_string(triangleCount);
 
@@ -191,23 +314,6 @@ void rst::rasterizer::show(std::string fps_str) const
     cv::imshow("Render Window", cv_image);
 }
 
-void rst::rasterizer::draw_point_triangle(Triangle &t)
-{
-    vertex_shader(vertex_payload, &t);
-    auto &vertex = t.get_vertex();
-    for (int i = 0; i < 3; ++i)
-    {
-        // 将标准化设备坐标（NDC）坐标转换到屏幕空间坐标
-        vertex[i].x = (vertex[i].x + 1.0f) * 0.5f * width;
-        vertex[i].y = (vertex[i].y + 1.0f) * 0.5f * height;
-    }
-
-    auto color = Color{255, 255, 255};
-    draw_point(vertex[0].head<2>(), color);
-    draw_point(vertex[1].head<2>(), color);
-    draw_point(vertex[2].head<2>(), color);
-}
-
 // Bresenham's 画线算法
 void rst::rasterizer::draw_line(const Vec3f &begin, const Vec3f &end, const Color &color)
 {
@@ -268,229 +374,435 @@ void rst::rasterizer::draw_line(const Vec3f &begin, const Vec3f &end, const Colo
     }
 }
 
-void rst::rasterizer::draw_triangle_line(Triangle &t) {
-    vertex_shader(vertex_payload, &t);
-    auto &vertex = t.get_vertex();
+void rst::rasterizer::draw_triangle_line(const face_indices &face) {
+    face_indices clipped[2];
+    int count = clip_triangle(face, clipped);
 
-    for (int i = 0; i < 3; ++i)
+    auto color = Color{255, 255, 255};
+    for (int i = 0; i < count; ++i)
     {
-        // 将标准化设备坐标（NDC）坐标转换到屏幕空间坐标
-        vertex[i].x = (vertex[i].x + 1.0f) * 0.5f * width;
-        vertex[i].y = (vertex[i].y + 1.0f) * 0.5f * height;
+        auto to_vec3 = [](const Vec2f &p) { return Vec3f{p.x, p.y, 0.f}; };
+        Vec3f a = to_vec3(screen_pos(clipped[i][0]));
+        Vec3f b = to_vec3(screen_pos(clipped[i][1]));
+        Vec3f c = to_vec3(screen_pos(clipped[i][2]));
+        draw_line(a, b, color);
+        draw_line(b, c, color);
+        draw_line(c, a, color);
     }
-
-    auto color = Color{255, 255, 255};
-    draw_line(t.a(), t.b(), color);
-    draw_line(t.b(), t.c(), color);
-    draw_line(t.c(), t.a(), color);
-    ++triangleCount;
+    if (count > 0)
+        ++triangleCount;
 }
 
-void rst::rasterizer::rasterize_triangle(Triangle &t)
+// 视锥体分类：三个顶点都在同一个面外侧的三角形直接丢弃（平凡拒绝），
+// 跨过近平面的三角形需要裁剪。左右上下四个面只做平凡拒绝，跨过它们的部分交给屏幕包围盒裁剪
+rst::rasterizer::clip_result rst::rasterizer::classify_triangle(const face_indices &face) const
 {
-    vertex_shader(vertex_payload, &t); // 顶点着色器
-    auto &vertex = t.get_vertex();
+    enum : int
+    {
+        CLIP_LEFT = 1,
+        CLIP_RIGHT = 2,
+        CLIP_BOTTOM = 4,
+        CLIP_TOP = 8,
+        CLIP_NEAR = 16,
+        CLIP_FAR = 32
+    };
+    auto outcode = [this](const Vec4f &v)
+    {
+        int code = 0;
+        if (v.x < -v.w()) code |= CLIP_LEFT;
+        if (v.x > v.w()) code |= CLIP_RIGHT;
+        if (v.y < -v.w()) code |= CLIP_BOTTOM;
+        if (v.y > v.w()) code |= CLIP_TOP;
+        if (v.w() < clip_near) code |= CLIP_NEAR;
+        if (v.w() > clip_far) code |= CLIP_FAR;
+        return code;
+    };
+    int code[3] = {outcode(transformed_clip_pos[face[0]]), outcode(transformed_clip_pos[face[1]]), outcode(transformed_clip_pos[face[2]])};
+    if (code[0] & code[1] & code[2])
+        return clip_result::rejected;
+    if ((code[0] | code[1] | code[2]) & CLIP_NEAR)
+        return clip_result::crossing;
+    return clip_result::inside;
+}
 
-    for (int i = 0; i < 3; ++i)
+// 对三角形做裁剪，结果（0~2 个三角形）写入 out，返回输出的三角形数。
+// 跨过近平面的三角形在齐次空间中用 Sutherland–Hodgman 算法裁剪到 w >= clip_near 一侧，
+// 裁出的多边形最多四个顶点，扇形拆成两个三角形。
+// 新顶点追加到 clipped_vertices，会修改共享的顶点缓冲，只能串行调用
+int rst::rasterizer::clip_triangle(const face_indices &face, face_indices *out)
+{
+    switch (classify_triangle(face))
     {
-        // 将标准化设备坐标（NDC）坐标转换到屏幕空间坐标
-        vertex[i].x = (vertex[i].x + 1.0f) * 0.5f * width;
-        vertex[i].y = (vertex[i].y + 1.0f) * 0.5f * height;
+    case clip_result::rejected:
+        return 0;
+    case clip_result::inside:
+        out[0] = face;
+        return 1;
+    default:
+        break;
     }
-    t.update(); // 更新三角形的边向量
 
-    if (t.get_double_area2D() < 0) // 三角形面积为负，背面剔除
-        return;
-
-    // 此时三角形已经是屏幕空间三角形
-    auto [min_x, min_y, max_x, max_y] = t.getBoundingBox();
-    auto view_pos = t.get_viewspace_pos(); // 顶点在视空间中的坐标（做透视矫正、插值要用）
+    auto lerp = [](const clip_vertex &a, const clip_vertex &b, float s) -> clip_vertex
+    {
+        return {a.clip_pos + (b.clip_pos - a.clip_pos) * s, a.tangent + (b.tangent - a.tangent) * s, a.view_pos + (b.view_pos - a.view_pos) * s,
+                a.normal + (b.normal - a.normal) * s, a.color + (b.color - a.color) * s,
+                a.tex_coords + (b.tex_coords - a.tex_coords) * s};
+    };
 
-    auto interpolate = [](float alpha, float beta, float gamma, const auto &array)
-    { return (alpha * array[0] + beta * array[1] + gamma * array[2]); }; // 对三角形各项属性做插值
+    clip_vertex in[3] = {fetch_vertex(face[0]), fetch_vertex(face[1]), fetch_vertex(face[2])};
 
-    // 对单个像素着色
-    auto pixel_render = [&](float x, float y, int ind) -> Vec3f
+    // 属性在齐次空间中是线性的，按到近平面的距离比例插值即可；原有顶点直接沿用下标
+    uint32_t polygon[4];
+    int n = 0;
+    for (int i = 0; i < 3; ++i)
     {
-        if (!t.insideTriangle(Vec3f{x, y, 1.0f}))
+        const auto &a = in[i];
+        const auto &b = in[(i + 1) % 3];
+        float da = a.clip_pos.w() - clip_near;
+        float db = b.clip_pos.w() - clip_near;
+        if (da >= 0)
+            polygon[n++] = face[i];
+        if ((da >= 0) != (db >= 0))
         {
-            return {-1.f, 0.f, 0.f};
-        }
-        auto [alpha, beta, gamma] = t.computeBarycentric2D(Vec2f{static_cast<float>(x), static_cast<float>(y)}); // 计算像素点的重心坐标
-        float z_corrected = 1.0f / (alpha / view_pos[0].z + beta / view_pos[1].z + gamma / view_pos[2].z);
-        float z_interpolated = z_corrected;
+            clip_vertex v = lerp(a, b, da / (da - db));
 
-        // 对重心坐标做透视校正
-        float a_corrected = alpha / view_pos[0].z * z_corrected;
-        float b_corrected = beta / view_pos[1].z * z_corrected;
-        float g_corrected = gamma / view_pos[2].z * z_corrected;
+            // 透视除法，并将标准化设备坐标（NDC）坐标转换到屏幕空间坐标
+            Vec4f ndc = v.clip_pos;
+            ndc /= ndc.w();
+            v.screen_pos = {(ndc.x + 1.0f) * 0.5f * width, (ndc.y + 1.0f) * 0.5f * height};
 
-        if (!anti_Aliasing)
-        {
-            if (z_interpolated < depth_buf[ind])
-            {
-                return {-1.f, 0.f, 0.f};
-            }
-            depth_buf[ind] = z_interpolated; // 更新z-buffer
-        }else {
-            if (z_interpolated < super_depth_buf[ind])
-            {
-                return {-1.f, 0.f, 0.f};
-            }
-            super_depth_buf[ind] = z_interpolated; // 更新z-buffer
+            polygon[n++] = static_cast<uint32_t>(transformed_screen_pos.size() + clipped_vertices.size());
+            clipped_vertices.push_back(v);
         }
+    }
 
-        pixel_shader_payload pixel_payload;
-        pixel_payload.color = interpolate(a_corrected, b_corrected, g_corrected, t.get_color());
-        pixel_payload.normal = interpolate(a_corrected, b_corrected, g_corrected, t.get_normal()).normalize(); // 确保法线是单位向量
-        pixel_payload.tex_coords = interpolate(a_corrected, b_corrected, g_corrected, t.get_tex_coords());
-        pixel_payload.view_pos = interpolate(a_corrected, b_corrected, g_corrected, view_pos);
-        pixel_payload.amb_light_intensity = scene->amb_light_intensity;
-
-        return fragment_shader(pixel_payload, *this);
-    };
+    int count = 0;
+    for (int k = 1; k + 1 < n; ++k)
+        out[count++] = {polygon[0], polygon[k], polygon[k + 1]};
+    return count;
+}
 
-    for (int y = min_y; y < max_y; ++y)
+// 屏幕空间三角形的 setup：顶点吸附到定点网格，背面剔除，计算边方程与包围盒
+bool rst::rasterizer::setup_triangle(const face_indices &face, triangle_setup &setup) const
+{
+    // 定点坐标限制在 2^30 以内，保证 A、B 不超出 int32，边方程值不超出 int64
+    constexpr float max_coord = static_cast<float>(1 << (30 - subpixel_bits));
+    int64_t fx[3], fy[3];
+    for (int i = 0; i < 3; ++i)
     {
-        for (int x = min_x; x < max_x; ++x)
-        {
-            if (x < 0 || x >= width || y < 0 || y >= height)
-                continue;
-
-            std::lock_guard<std::mutex> pixel_lock(pixel_Mutex[x * y + y]);
-            Vec3f pixel_color{0.f, 0.f, 0.f};
-            if (!anti_Aliasing) {
-                pixel_color = pixel_render(x + 0.5f, y + 0.5f, get_index(x, y));
-                if (pixel_color.x == -1.f)
-                    continue;
+        const Vec2f &p = screen_pos(face[i]);
+        if (!(std::abs(p.x) < max_coord && std::abs(p.y) < max_coord))
+            return false;
+        fx[i] = std::llround(p.x * subpixel_one);
+        fy[i] = std::llround(p.y * subpixel_one);
+    }
 
-            }else {
-                // 在这里实现抗锯齿
-                auto ind = get_index(x, y) * samples * samples;
-  
-                for (int i = 0; i < samples; ++i)
-                {
-                    for (int j = 0; j < samples; ++j)
-                    {
-                        int index = ind + i * samples + j;
-                        float sub_x = x + (i + 0.5f) / samples;
-                        float sub_y = y + (j + 0.5f) / samples;
-                        auto sub_pixel_color = pixel_render(sub_x, sub_y, index);
-                        if (sub_pixel_color.x == -1.f) {
-                            continue;
-                        }
-                        super_back_buf[index] = sub_pixel_color;
-                    }
-                }
-                pixel_color = (super_back_buf[ind] + super_back_buf[ind + 1] + super_back_buf[ind + 2] + super_back_buf[ind + 3]) / 4;
-            }
+    int64_t area = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]); // 有向面积的两倍
+    if (area <= 0) // 三角形面积为负，背面剔除；吸附后退化的三角形不覆盖任何像素
+        return false;
+
+    // 包围盒（像素），右移即向下取整
+    int min_x = static_cast<int>(std::min({fx[0], fx[1], fx[2]}) >> subpixel_bits);
+    int min_y = static_cast<int>(std::min({fy[0], fy[1], fy[2]}) >> subpixel_bits);
+    int max_x = static_cast<int>(-(-std::max({fx[0], fx[1], fx[2]}) >> subpixel_bits));
+    int max_y = static_cast<int>(-(-std::max({fy[0], fy[1], fy[2]}) >> subpixel_bits));
+    setup.ox = min_x;
+    setup.oy = min_y;
+    const int64_t origin_x = static_cast<int64_t>(min_x) << subpixel_bits;
+    const int64_t origin_y = static_cast<int64_t>(min_y) << subpixel_bits;
+
+    // 边方程系数：E_i 为顶点 j -> k 这条边（i, j, k 轮换）
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3, k = (i + 2) % 3;
+        int64_t a = fy[j] - fy[k];
+        int64_t b = fx[k] - fx[j];
+        setup.A[i] = static_cast<int32_t>(a);
+        setup.B[i] = static_cast<int32_t>(b);
+        setup.C[i] = a * (origin_x - fx[j]) + b * (origin_y - fy[j]) - (is_top_left_edge(setup.A[i], setup.B[i]) ? 0 : 1);
+    }
+    setup.inv_area = 1.f / static_cast<float>(area);
 
-            set_pixel({x, y}, pixel_color / 255.f);
-        }
+    float z[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        uint32_t index = face[i];
+        size_t count = transformed_view_pos.size();
+        z[i] = index < count ? transformed_view_pos[index].z : clipped_vertices[index - count].view_pos.z;
     }
-    ++triangleCount;
+    setup.z_min = std::min({z[0], z[1], z[2]});
+    setup.z_max = std::max({z[0], z[1], z[2]});
+
+    setup.min_x = std::max(min_x, 0);
+    setup.min_y = std::max(min_y, 0);
+    setup.max_x = std::min(max_x, width);
+    setup.max_y = std::min(max_y, height);
+    setup.vertex = face;
+    return true;
 }
 
-void rst::rasterizer::rasterize_triangle_list(std::vector<Triangle> &triangles) {
+// 取出本帧第 index 个顶点的全部属性
+rst::rasterizer::clip_vertex rst::rasterizer::fetch_vertex(uint32_t index) const
+{
+    size_t count = transformed_clip_pos.size();
+    if (index >= count)
+        return clipped_vertices[index - count];
+
+    // 颜色和纹理坐标不随实例变化，所有实例读取同一份网格数据
+    const size_t vertex = index % current_mesh->vertex_count();
+    return {transformed_clip_pos[index], transformed_tangent[index], transformed_view_pos[index], transformed_normal[index],
+            current_mesh->colors[vertex], current_mesh->tex_coords[vertex], transformed_screen_pos[index]};
+}
+
+void rst::rasterizer::draw_mesh(const Mesh &mesh, std::span<const Matrix4f> models)
+{
+    if (mesh.triangle_count() == 0)
+        return;
+
+    // 小网格的多个实例合成一批，大网格每个实例单独一批
+    const size_t per_batch = std::max<size_t>(1, max_batch_triangles / mesh.triangle_count());
+    for (size_t first = 0; first < models.size(); first += per_batch)
+        draw_batch(mesh, models.subspan(first, std::min(per_batch, models.size() - first)));
+}
+
+void rst::rasterizer::draw_batch(const Mesh &mesh, std::span<const Matrix4f> models)
+{
+    // 每个实例的变换矩阵只计算一次
+    instance_payloads.resize(models.size());
+    for (size_t k = 0; k < models.size(); ++k)
+    {
+        auto &payload = instance_payloads[k];
+        payload = vertex_payload;
+        payload.model = models[k];
+        payload.mvp = vertex_payload.projection * vertex_payload.view * payload.model;
+        payload.model_view = vertex_payload.view * payload.model;
+        payload.inv_trans = payload.model_view.inverse().transpose();
+    }
 
-    if (!multithreading)
+    (this->*vertex_stage)(mesh);
+
+    if (multithreading && renderMode == FACE)
+    {
+        rasterize_batch_tiled();
+        return;
+    }
+
+    // 线框、顶点模式开销很小，直接串行绘制
+    const size_t faces = batch_triangle_count();
+    switch (renderMode)
     {
-        switch (renderMode)
+    case FACE:
+        for (size_t i = 0; i < faces; ++i)
         {
-        case FACE:
-            for (auto t : triangles)
-                rasterize_triangle(t);
-            break;
-        case EDGE:
-            for (auto t : triangles)
-                draw_triangle_line(t);
-            break;
-        case VERTEX:
-            for (auto t : triangles)
-                draw_point_triangle(t);
-            break;
-        default:
-            break;
+            face_indices clipped[2];
+            int count = clip_triangle(batch_face(i), clipped);
+
+            for (int k = 0; k < count; ++k)
+            {
+                triangle_setup setup;
+                if (!setup_triangle(clipped[k], setup))
+                    continue;
+
+                (this->*fragment_stage)(setup, 0, 0, width, height);
+                ++triangleCount;
+            }
         }
-    }
-    else
+        break;
+    case EDGE:
+        for (size_t i = 0; i < faces; ++i)
+            draw_triangle_line(batch_face(i));
+        break;
+    case VERTEX:
     {
-        // // 引入线程池做多线程
-        // ThreadPool mypool(8);
-
-        // switch (renderMode)
-        // {
-        // case FACE:
-        //     for (auto t : triangles)
-        //         mypool.enqueue([this](Triangle &t)
-        //                        { rasterize_triangle(t); }, t);
-        //     break;
-        // case EDGE:
-        //     for (auto t : triangles)
-        //         draw_triangle_line(t);
-        //     break;
-        // case VERTEX:
-        //     for (auto t : triangles)
-        //         draw_point_triangle(t);
-        //     break;
-        // default:
-        //     break;
-        // }
-
-        // 多线程渲染
-        std::queue<Triangle> taskQueue;
-        // 将待渲染三角形添加到队列
-        for (const auto &t : triangles)
+        // 顶点模式直接画出每个唯一顶点，近平面之前的顶点没有意义，直接丢弃
+        auto color = Color{255, 255, 255};
+        for (size_t i = 0; i < transformed_screen_pos.size(); ++i)
         {
-            taskQueue.push(t);
+            if (transformed_clip_pos[i].w() >= clip_near)
+                draw_point(transformed_screen_pos[i], color);
         }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// 分块（sort-middle）多线程光栅化：
+// 1. 所有三角形并行做视锥体剔除与 setup，每个输入三角形预留两个位置；
+//    少数跨过近平面的三角形要向顶点缓冲追加新顶点，留到第 2 步串行裁剪；
+// 2. 按提交顺序把三角形分到覆盖的屏幕分块中；
+// 3. 每个线程一次领取一整块，块内按提交顺序光栅化。
+// 同一像素只会被一个线程写入，且三角形顺序与单线程一致，所以结果与单线程逐位相同
+void rst::rasterizer::rasterize_batch_tiled()
+{
+    // 1. 三角形 setup
+    const size_t count = batch_triangle_count();
+    setup_records.resize(count * 2);
+    setup_state.assign(count * 2, SLOT_EMPTY);
 
-        // 工作线程函数
-        auto worker = [&]()
+    jobs.parallel_for(0, count, setup_grain, [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
         {
-            while (true)
+            face_indices face = batch_face(i);
+            switch (classify_triangle(face))
             {
-                Triangle t;
-                {
-                    std::lock_guard<std::mutex> lock(queueMutex);
-                    if (taskQueue.empty())
-                        break;
-                    t = taskQueue.front();
-                    taskQueue.pop();
-                }
-                if (renderMode == FACE)
-                    rasterize_triangle(t);
-                else if (renderMode == EDGE)
-                    draw_triangle_line(t);
-                else if (renderMode == VERTEX)
-                    draw_point_triangle(t);
+            case clip_result::inside:
+                if (setup_triangle(face, setup_records[i * 2]))
+                    setup_state[i * 2] = SLOT_VISIBLE;
+                break;
+            case clip_result::crossing:
+                setup_state[i * 2] = SLOT_NEEDS_CLIP;
+                break;
+            default:
+                break;
             }
-        };
+        }
+    });
+
+    // 2. 分块（binning）
+    for (auto &bin : tile_bins)
+        bin.clear();
 
-        // 启动线程
-        const size_t num_threads = std::thread::hardware_concurrency();
-        std::vector<std::thread> threads;
-        for (size_t i = 0; i < num_threads; ++i)
+    for (size_t i = 0; i < count * 2; ++i)
+    {
+        if (setup_state[i] == SLOT_NEEDS_CLIP)
         {
-            threads.emplace_back(worker);
+            face_indices clipped[2];
+            int clipped_count = clip_triangle(batch_face(i / 2), clipped);
+            setup_state[i] = SLOT_EMPTY;
+            for (int k = 0; k < clipped_count; ++k)
+                if (setup_triangle(clipped[k], setup_records[i + k]))
+                    setup_state[i + k] = SLOT_VISIBLE;
         }
+        if (setup_state[i] != SLOT_VISIBLE)
+            continue;
 
-        // 等待线程结束
-        for (auto &thread : threads)
+        const auto &setup = setup_records[i];
+        ++triangleCount;
+        if (setup.min_x >= setup.max_x || setup.min_y >= setup.max_y)
+            continue;
+
+        for (int ty = setup.min_y / tile_size; ty <= (setup.max_y - 1) / tile_size; ++ty)
+            for (int tx = setup.min_x / tile_size; tx <= (setup.max_x - 1) / tile_size; ++tx)
+                tile_bins[ty * tiles_x + tx].push_back(static_cast<uint32_t>(i));
+    }
+
+    // 3. 按块光栅化
+    // 每个块单独作为一个任务，块之间负载差异由任务窃取平衡
+    jobs.parallel_for(0, tiles_x * tiles_y, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t tile = begin; tile < end; ++tile)
         {
-            thread.join();
+            int x0 = static_cast<int>(tile % tiles_x) * tile_size;
+            int y0 = static_cast<int>(tile / tiles_x) * tile_size;
+            int x1 = std::min(x0 + tile_size, width);
+            int y1 = std::min(y0 + tile_size, height);
+            for (auto i : tile_bins[tile])
+                (this->*fragment_stage)(setup_records[i], x0, y0, x1, y1);
         }
-    }
+    });
 }
 
 void rst::rasterizer::draw_obj(const std::unique_ptr<Object> &obj)
 {
-    // 获取物体的三角形列表
+    // 获取物体的网格
     auto mesh = dynamic_cast<MeshTriangle *>(obj.get());
     if (!mesh)
         return; // 确保类型转换成功
 
-    rasterize_triangle_list(mesh->Triangles);
+    // 模型矩阵 = 场景模型矩阵（set_model） * 物体变换 * 实例变换
+    const Matrix4f object_model = vertex_payload.model * mesh->transform;
+
+    // 物体已经通过了 BVH 的剔除，这里再用网格自己的包围盒在模型空间中逐个测试实例
+    const Matrix4f view_projection = vertex_payload.projection * vertex_payload.view;
+    const AABB bounds(mesh->mesh.bounds_min, mesh->mesh.bounds_max);
+    auto add_instance = [&](const Matrix4f &model)
+    {
+        if (!Frustum(view_projection * model, clip_near, clip_far).intersects(bounds))
+        {
+            ++culled_objects;
+            return;
+        }
+        lod_instances[select_lod(*mesh, model)].push_back(model);
+    };
+
+    // 每个实例单独选择 LOD 级别，同一级别的实例合在一起做一次实例化绘制
+    lod_instances.resize(mesh->lods.size() + 1);
+    for (auto &models : lod_instances)
+        models.clear();
+    if (mesh->instances.empty())
+        add_instance(object_model);
+    for (const Matrix4f &instance : mesh->instances)
+        add_instance(object_model * instance);
+
+    for (size_t level = 0; level < lod_instances.size(); ++level)
+        if (!lod_instances[level].empty())
+            draw_mesh(level == 0 ? mesh->mesh : mesh->lods[level - 1], lod_instances[level]);
+}
+
+size_t rst::rasterizer::select_lod(const MeshTriangle &object, const Matrix4f &model) const
+{
+    const Mesh &mesh = object.mesh;
+    if (!lod_enabled || object.lods.empty())
+        return 0;
+
+    // 包围球取包围盒的中心和半对角线，半径按模型矩阵各轴中最大的缩放放大
+    float scale = 0.f;
+    for (int j = 0; j < 3; ++j)
+        scale = std::max(scale, Vec3f{model.m[0][j], model.m[1][j], model.m[2][j]}.norm());
+    const float radius = (mesh.bounds_max - mesh.bounds_min).norm() * 0.5f * scale;
+    const Vec3f center = (vertex_payload.view * (model * ((mesh.bounds_min + mesh.bounds_max) * 0.5f).toVector4(1.f))).head<3>();
+    const float distance = -center.z;
+    if (distance <= radius)
+        return 0; // 相机在包围球内或离得很近
+
+    // 投影半径（像素）= 半径 * 投影矩阵的 y 缩放 * 半屏高 / 距离
+    const float projected_radius = radius * vertex_payload.projection.m[1][1] * height * 0.5f / distance;
+    const float budget = static_cast<float>(MY_PI) * projected_radius * projected_radius / lod_pixels_per_triangle;
+    if (mesh.triangle_count() <= budget)
+        return 0;
+    for (size_t i = 0; i < object.lods.size(); ++i)
+        if (object.lods[i].triangle_count() <= budget)
+            return i + 1;
+    return object.lods.size();
+}
+
+void rst::rasterizer::update_uniforms()
+{
+    const auto &lights = scene->get_lights();
+    if (lights.size() > max_lights)
+        LOGE("Too many lights: {}, only the first {} are used", lights.size(), max_lights);
+
+    const Material &mat = *material;
+    uniforms.ka = mat.Ka;
+    uniforms.kd = mat.Kd;
+    uniforms.ks = mat.Ks;
+    uniforms.specular_exponent = mat.specularExponent;
+    uniforms.ambient = mat.Ka.cwiseProduct(scene->amb_light_intensity);
+
+    // 光源变换到视空间，与插值得到的片元坐标处于同一空间
+    uniforms.light_count = static_cast<int>(std::min<size_t>(lights.size(), max_lights));
+    for (int i = 0; i < uniforms.light_count; ++i)
+    {
+        const Light &light = *lights[i];
+        auto &out = uniforms.lights[i];
+        out.position = (vertex_payload.view * light.position.toVector4(1.f)).head<3>();
+        out.intensity = light.intensity;
+        out.specular = light.intensity.cwiseProduct(mat.Ks);
+    }
+
+    uniforms.diffuse_map = mat.map_Kd.get();
+    uniforms.bump_map = mat.map_bump.get();
+    uniforms.normal_map = mat.map_normal.get();
+    // 有凹凸贴图时自动改用高度梯度图；第一次遇到某张凹凸贴图时由缓存生成，之后直接复用
+    if (mat.map_bump != bump_source)
+    {
+        bump_source = mat.map_bump;
+        bump_gradient = bump_source ? TextureCache::get_instance().load(bump_source->getPath(), TextureFormat::HeightGradient) : nullptr;
+    }
+    uniforms.bump_gradient = bump_gradient.get();
 }
 
 void rst::rasterizer::draw()
@@ -509,22 +821,53 @@ void rst::rasterizer::draw()
         return;
     }
 
+    if (vertex_stage == nullptr || (renderMode == FACE && fragment_stage == nullptr))
+    {
+        LOGE("No shader set!");
+        return;
+    }
+
     // 设置视图变换
     set_view(camera->eye_pos, camera->target_pos, camera->up_dir);
 
     // 设置投影矩阵
     set_projection(scene->get_filedofView(), scene->get_aspect_ratio(), -1.f, -50.0f);
 
-    vertex_payload.mvp = vertex_payload.projection * vertex_payload.view * vertex_payload.model;
-    vertex_payload.inv_trans = (vertex_payload.view * vertex_payload.model).inverse().transpose();
-
-    clearBuff(rst::Buffers::Color | rst::Buffers::Depth); // 清空缓冲区
-    // 遍历场景中的所有物体
-    for (const auto &obj : scene->get_objects())
+    clearBuff(rst::Buffers::Color | rst::Buffers::Depth); // 清空缓冲区（延迟到分块被触及时）
+    // 遍历物体 BVH：整棵在视锥体外的子树直接跳过，开销只与可见部分有关；
+    // 可见物体大致按由近到远的顺序绘制，后绘制的物体更容易被 Hi-Z 整块剔除
+    const auto &objects = scene->get_objects();
+    const Frustum frustum(vertex_payload.projection * vertex_payload.view * vertex_payload.model, clip_near, clip_far);
+    size_t visible_objects = 0;
+    culled_objects = 0;
+    scene->get_bvh().traverse(frustum, [&](size_t index)
     {
+        const auto &obj = objects[index];
         set_material(obj->material);
+        update_uniforms();
         draw_obj(obj);
+        ++visible_objects;
+    });
+    culled_objects += objects.size() - visible_objects;
+
+    for (int tile = 0; tile < tiles_x * tiles_y; ++tile)
+    {
+        int x0, y0, x1, y1;
+        tile_rect(tile, x0, y0, x1, y1);
+        if (tile_color_epoch[tile] == color_epoch)
+        {
+            // msaa 下片元只写入子采样缓冲区，需要求平均得到最终颜色
+            if (anti_Aliasing && renderMode == FACE)
+                resolve_samples(x0, y0, x1, y1);
+        }
+        else if (!back_tile_blank[tile])
+        {
+            // 本帧没有被触及的分块显示清除色，后缓冲区里已经是清除色时不再写入
+            clear_bytes += fill_tile(back_buf, tile, 1, Vec3f{0, 0, 0});
+            back_tile_blank[tile] = true;
+        }
     }
 
     std::swap(back_buf, image->get_frame_buf());
+    std::swap(back_tile_blank, front_tile_blank);
 }
\ No newline at end of file
@@ -1,7 +1,7 @@
 ﻿#pragma once
 #include <optional>
-#include "ThreadPool.hpp"
-#include "Triangle.h"
+#include <atomic>
+#include "JobSystem.hpp"
 #include "Image.h"
 #include "Texture.h"
 #include "Scene.hpp"
@@ -15,20 +15,111 @@ namespace rst
         Matrix4f view;
         Matrix4f projection;
         Matrix4f mvp;
+        Matrix4f model_view; // 每个实例只计算一次，顶点着色器不再逐顶点重复相乘
         Matrix4f inv_trans;
     };
 
+    // 顶点着色器输出：每个唯一顶点每帧只计算一次，存放在变换后的顶点缓冲中
+    struct vertex_shader_output
+    {
+        Vec4f clip_pos; // 齐次裁剪空间坐标（尚未做透视除法）
+        Vec3f view_pos;
+        Vec3f normal;
+        Vec4f tangent; // 视空间切线，w 为副切线方向
+    };
+
     struct pixel_shader_payload
     {
         Vec3f view_pos;
         Vec3f color;
         Vec3f normal;
-        Vec3f amb_light_intensity;
         Vec2f tex_coords;
+        Vec2f tex_dx, tex_dy; // 纹理坐标沿屏幕 x、y 方向每个像素的变化量，用于选择 mipmap 层级
+        Vec3f tangent;        // 插值后的视空间切线（未归一化）
+        float bitangent_sign; // 副切线 = bitangent_sign * (normal × tangent)
+    };
+
+    // 每次绘制前准备好的着色常量（uniforms）：光源已变换到视空间并预乘材质系数，
+    // 着色器只读这一块连续内存，逐片元路径上不再经过场景、相机和材质的指针
+    constexpr int max_lights = 8;
+    struct shading_uniforms
+    {
+        struct light
+        {
+            Vec3f position;  // 视空间
+            Vec3f intensity;
+            Vec3f specular;  // intensity ⊙ Ks
+        };
+        std::array<light, max_lights> lights;
+        int light_count = 0;
+
+        Vec3f eye_pos{0.f, 0.f, 0.f}; // 视空间中相机位于原点
+        Vec3f ambient;                // Ka ⊙ 环境光强度，每个片元只加一次
+        Vec3f ka, kd, ks;
+        float specular_exponent = 0.f;
+
+        const Texture *diffuse_map = nullptr; // 没有贴图时为空
+        const Texture *bump_map = nullptr;
+        const Texture *bump_gradient = nullptr; // 凹凸贴图预先求好的高度梯度（HeightGradient），每个片元一次采样
+        const Texture *normal_map = nullptr;    // 切线空间法线贴图
     };
 
-    using PixelShader = std::function<Vec3f(const pixel_shader_payload &, rasterizer &)>;
-    using VertexShader = std::function<void(vertex_shader_payload &, Triangle *)>;
+    // 批量着色：光栅化器一次把最多 fragment_lanes 个片元交给着色器，属性按分量分开存放（SoA），
+    // 着色器按通道循环处理，循环体可以被编译器向量化。前 count 个通道有效，其余通道是最后一个有效片元的拷贝，
+    // 着色器可以直接处理全部通道而不用关心掩码
+    constexpr int fragment_lanes = 8;
+    struct fragment_lanes3
+    {
+        alignas(32) float x[fragment_lanes];
+        alignas(32) float y[fragment_lanes];
+        alignas(32) float z[fragment_lanes];
+    };
+    struct fragment_batch
+    {
+        int count;
+        fragment_lanes3 view_pos;
+        fragment_lanes3 color;
+        fragment_lanes3 normal; // 单位向量
+        fragment_lanes3 tangent; // 未归一化，含义同 pixel_shader_payload::tangent
+        float bitangent_sign;    // 一批片元来自同一个三角形，副切线方向相同
+        alignas(32) float u[fragment_lanes];
+        alignas(32) float v[fragment_lanes];
+        alignas(32) float du_dx[fragment_lanes]; // 纹理坐标的屏幕空间导数，含义同 pixel_shader_payload::tex_dx/tex_dy
+        alignas(32) float dv_dx[fragment_lanes];
+        alignas(32) float du_dy[fragment_lanes];
+        alignas(32) float dv_dy[fragment_lanes];
+        fragment_lanes3 result; // 着色结果（0~255），由着色器写入
+    };
+
+    // 提供 shade_batch 的着色器走批量着色路径，否则逐片元调用 operator()
+    template <class Shader>
+    concept batch_shader = requires(const Shader &shader, fragment_batch &batch, const shading_uniforms &uniforms) { shader.shade_batch(batch, uniforms); };
+
+    // 亚像素精度：顶点坐标吸附到 1/256 像素的定点网格上
+    constexpr int subpixel_bits = 8;
+    constexpr int subpixel_one = 1 << subpixel_bits;
+    constexpr int subpixel_half = subpixel_one / 2;
+
+    // 左上填充规则：屏幕 y 轴向上、三角形逆时针时，E 随 x 增大的边是左边，水平且内侧在下方的边是上边
+    constexpr bool is_top_left_edge(int32_t a, int32_t b) { return a > 0 || (a == 0 && b < 0); }
+
+    // 三角形 setup 结果：边方程 E_i(x, y) = A_i * (x - ox) + B_i * (y - oy) + C_i 每个三角形只计算一次
+    // x, y 为定点亚像素坐标，边方程全部用整数计算，结果与计算顺序、线程数无关
+    // E_i 对应顶点 i 的对边，E_i * inv_area 即顶点 i 的屏幕空间重心坐标
+    // 以包围盒左下角的整数像素 (ox, oy) 为原点，避免用绝对屏幕坐标时数值过大
+    // C_i 已包含左上填充规则的偏置：恰好落在非左边、非上边上的采样点不算覆盖，
+    // 闭合网格中共享边上的像素只会被其中一个三角形着色
+    // 只保存光栅化循环需要的数据，分块多线程时每个三角形只需要这一条紧凑记录
+    struct triangle_setup
+    {
+        std::array<int32_t, 3> A, B; // x、y 每变化一个亚像素时 E 的增量
+        std::array<int64_t, 3> C;
+        float inv_area;
+        int ox, oy;
+        float z_min, z_max; // 三个顶点视空间深度的范围，用于 Hi-Z 整块剔除
+        int min_x, min_y, max_x, max_y; // 已裁剪到屏幕范围的包围盒，[min, max)
+        std::array<uint32_t, 3> vertex; // 三个顶点在本帧顶点缓冲中的下标，着色时再读取属性
+    };
 
     enum RenderMode
     {
@@ -53,6 +144,16 @@ namespace rst
         return Buffers((int)a & (int)b);
     }
 
+    // 各渲染目标缓冲区当前占用的内存（字节）
+    struct buffer_memory
+    {
+        size_t color = 0;        // 前、后颜色缓冲区
+        size_t depth = 0;        // 深度缓冲区与 Hi-Z
+        size_t sample_color = 0; // msaa 子采样颜色
+        size_t sample_depth = 0; // msaa 子采样深度
+        size_t total() const { return color + depth + sample_color + sample_depth; }
+    };
+
     class rasterizer
     {
     public:
@@ -73,56 +174,184 @@ namespace rst
         void set_view(const Vec3f &target_pos, const Vec3f &eye_dir, const Vec3f &up_dir);
         void set_projection(float eye_fov, const float &aspect_ratio, const float &zNear, const float &zFar);
 
-        void set_vertex_shader(VertexShader vert_shader) { vertex_shader = vert_shader; }
-        void set_fragment_shader(PixelShader frag_shader) { fragment_shader = frag_shader; }
+        // 着色器是无状态的函数对象类型，管线以着色器类型为模板参数实例化（见 rasterizer_pipeline.hpp），
+        // 着色器在循环中内联展开，运行时切换着色器只是换一个预先实例化的管线，每个三角形一次间接调用
+        using VertexPipeline = void (rasterizer::*)(const Mesh &);
+        using FragmentPipeline = void (rasterizer::*)(const triangle_setup &, int, int, int, int);
+        template <class Shader>
+        static VertexPipeline vertex_pipeline() { return &rasterizer::process_vertices<Shader>; }
+        template <class Shader>
+        static FragmentPipeline fragment_pipeline() { return &rasterizer::rasterize_setup_triangle<Shader>; }
+
+        void set_vertex_shader(VertexPipeline pipeline) { vertex_stage = pipeline; }
+        void set_fragment_shader(FragmentPipeline pipeline) { fragment_stage = pipeline; }
 
         void set_scene(Scene &scene) { this->scene = &scene; }
         void set_material(Material &mat) { material = mat; }
         void set_pixel(const Vec2i &point, const Vec3f &color);  // 渲染区用
-        void set_rendermode(RenderMode mode) { renderMode = mode; }
+        void set_rendermode(RenderMode mode) { renderMode = mode; update_attachments(); }
         void clearBuff(Buffers buff);
         void show(std::string) const;
 
         void draw_point(const Vec2f p, const Color &color) { set_pixel({p.x, p.y}, color.getVec()); }
-        void draw_point_triangle(Triangle &t);
         void draw_line(const Vec3f &begin, const Vec3f &end, const Color &color);
-        void draw_triangle_line(Triangle &t);
-        void rasterize_triangle(Triangle &t);
-        void rasterize_triangle_list(std::vector<Triangle> &triangles);
+        // 实例化绘制：网格按 models 中的每个模型矩阵各画一次，网格数据只有一份
+        void draw_mesh(const Mesh &mesh, std::span<const Matrix4f> models);
         void draw_obj(const std::unique_ptr<Object> &obj);
         void draw();
 
         auto get_scene() const { return scene; }
         auto& get_material() const { return material; }
+        const shading_uniforms &get_uniforms() const { return uniforms; }
         auto is_multi_Thread() const { return multithreading; }
         auto is_anti_Aliasing() const { return anti_Aliasing; }
+        size_t get_hiz_rejected_tiles() const { return hiz_rejected_tiles; } // 本帧被 Hi-Z 整块剔除的 8x8 块数
+        size_t get_clear_bytes() const { return clear_bytes; }               // 本帧清除缓冲区写入的字节数
+        size_t get_culled_objects() const { return culled_objects; }         // 本帧被视锥体剔除的物体和实例数
         void switch_multi_Thread() { multithreading = !multithreading; }
-        void switch_anti_Aliasing() { anti_Aliasing = !anti_Aliasing; }
+        void set_setup_grain(size_t grain) { setup_grain = std::max<size_t>(grain, 1); } // 多线程 setup 每个任务最多处理的三角形数
+        void switch_anti_Aliasing() { anti_Aliasing = !anti_Aliasing; update_attachments(); }
+        void set_sample_count(int count); // msaa 每像素子采样数：1/2/4/8
+        void switch_lod() { lod_enabled = !lod_enabled; }
+        auto is_lod_enabled() const { return lod_enabled; }
+        void set_lod_pixels_per_triangle(float pixels) { lod_pixels_per_triangle = std::max(pixels, 1e-3f); }
+        auto get_sample_count() const { return sample_count; }
+        buffer_memory get_buffer_memory() const;
     private:
-        // 多线程使用
-        std::mutex queueMutex; // 任务队列锁
-        std::vector<std::mutex> pixel_Mutex;
+        // 多线程使用（分块渲染：每个线程独占整块屏幕区域，深度测试与写颜色无需加锁）
+        JobSystem jobs{std::max(1u, std::thread::hardware_concurrency()) - 1}; // 常驻线程，调用线程也参与计算
+        size_t setup_grain = 256;
+        static constexpr int tile_size = 64;
+        int tiles_x, tiles_y;
+        std::vector<triangle_setup> setup_records;    // 已完成裁剪与 setup 的三角形，每个输入三角形占两个位置
+        std::vector<char> setup_state;                // 对应位置的状态（setup_slot）
+        std::vector<std::vector<uint32_t>> tile_bins; // 每个分块覆盖到的三角形下标（保持提交顺序）
         bool multithreading = false;
 
+        // 分块延迟清除：clearBuff 只推进清除编号，分块第一次被三角形触及时才真正清除该块；
+        // 整帧都没有被触及的背景分块不写深度，颜色只在后缓冲区里还不是清除色时写一次
+        uint32_t color_epoch = 1, depth_epoch = 1;  // 当前颜色/深度缓冲的清除编号
+        std::vector<uint32_t> tile_color_epoch;      // 每个分块最后一次清除颜色时的编号
+        std::vector<uint32_t> tile_depth_epoch;      // 每个分块最后一次清除深度时的编号
+        std::vector<char> back_tile_blank;           // 后缓冲区中该分块是否全是清除色
+        std::vector<char> front_tile_blank;          // 前缓冲区（image 的帧缓冲）中该分块是否全是清除色
+        std::atomic<size_t> clear_bytes = 0;
+        void prepare_tile(int tile);
+        void prepare_tiles(int x0, int y0, int x1, int y1);
+        void tile_rect(int tile, int &x0, int &y0, int &x1, int &y1) const;
+        template <class T>
+        size_t fill_tile(std::vector<T> &buf, int tile, int per_pixel, const T &value);
+
+        enum setup_slot : char
+        {
+            SLOT_EMPTY,     // 没有三角形（被剔除，或裁剪后不足两个）
+            SLOT_VISIBLE,   // 已完成 setup
+            SLOT_NEEDS_CLIP // 跨过近平面，等待分块前串行裁剪
+        };
+
+        // 裁剪：顶点着色后先在齐次空间做视锥体平凡拒绝和近平面裁剪，再透视除法、映射到屏幕
+        using face_indices = std::array<uint32_t, 3>;
+        enum class clip_result
+        {
+            rejected, // 三个顶点都在视锥体同一个面的外侧
+            inside,   // 不跨过近平面，无需裁剪
+            crossing  // 跨过近平面，需要裁剪
+        };
+        float clip_near = 1.f, clip_far = 50.f; // 近/远平面到相机的距离（即裁剪空间中 w 的范围）
+        clip_result classify_triangle(const face_indices &face) const;
+        int clip_triangle(const face_indices &face, face_indices *out);
+
+        bool setup_triangle(const face_indices &face, triangle_setup &setup) const;
+        void draw_batch(const Mesh &mesh, std::span<const Matrix4f> models);
+        void rasterize_batch_tiled();
+        template <class Shader>
+        void rasterize_setup_triangle(const triangle_setup &setup, int clip_min_x, int clip_min_y, int clip_max_x, int clip_max_y);
+        void draw_triangle_line(const face_indices &face);
+
     private:
         rasterizer(int w, int h, const std::string &format);
         Scene* scene;
         std::optional<Material> material;
         RenderMode renderMode{FACE};
         size_t triangleCount = 0;
+        size_t culled_objects = 0;
         
         vertex_shader_payload vertex_payload;
-        PixelShader fragment_shader;
-        VertexShader vertex_shader;
+        shading_uniforms uniforms;
+        // 凹凸贴图对应的高度梯度图，换材质时才从 TextureCache 中查找
+        std::shared_ptr<const Texture> bump_source, bump_gradient;
+        void update_uniforms(); // 由当前场景、相机和材质生成着色常量，每个物体绘制前调用一次
+
+        // 实例化绘制按批进行：一批中的实例一起做顶点处理、setup 和分块光栅化，
+        // 实例 k 的顶点在顶点缓冲中排在前 k 个实例之后；每批最多约 max_batch_triangles 个三角形，限制 setup 记录的内存
+        static constexpr size_t max_batch_triangles = 1 << 16;
+        std::vector<vertex_shader_payload> instance_payloads; // 当前批每个实例的变换矩阵
+        std::vector<std::vector<Matrix4f>> lod_instances;     // 按选中的 LOD 级别分组的实例模型矩阵
+        size_t batch_triangle_count() const { return current_mesh->triangle_count() * instance_payloads.size(); }
+        // 当前批中的第 i 个三角形在顶点缓冲中的三个顶点下标
+        face_indices batch_face(size_t i) const
+        {
+            const size_t faces = current_mesh->triangle_count();
+            const size_t instance = i / faces;
+            const uint32_t *index = &current_mesh->indices[(i - instance * faces) * 3];
+            const uint32_t base = static_cast<uint32_t>(instance * current_mesh->vertex_count());
+            return {index[0] + base, index[1] + base, index[2] + base};
+        }
+
+        // LOD：按物体包围球投影到屏幕上的面积给出三角形预算，选择不超过预算的最精细一级
+        bool lod_enabled = true;
+        float lod_pixels_per_triangle = 4.f; // 平均每个三角形覆盖的像素数
+        size_t select_lod(const MeshTriangle &object, const Matrix4f &model) const; // 0 为原网格，i 为 lods[i - 1]
+        VertexPipeline vertex_stage = nullptr;
+        FragmentPipeline fragment_stage = nullptr;
+
+        // 顶点处理：网格中每个唯一顶点每个实例只做一次顶点着色，结果按属性分开连续存放（SoA）
+        const Mesh *current_mesh = nullptr;
+        std::vector<Vec4f> transformed_clip_pos;
+        std::vector<Vec3f> transformed_view_pos;
+        std::vector<Vec3f> transformed_normal;
+        std::vector<Vec4f> transformed_tangent;
+        std::vector<Vec2f> transformed_screen_pos; // 透视除法后映射到屏幕的坐标，只对近平面之后的顶点有效
+        template <class Shader>
+        void process_vertices(const Mesh &mesh);
+
+        // 本帧一个顶点的全部属性；近平面裁剪产生的新顶点也存成这种形式，下标接在网格顶点之后
+        struct clip_vertex
+        {
+            Vec4f clip_pos, tangent;
+            Vec3f view_pos, normal, color;
+            Vec2f tex_coords, screen_pos;
+        };
+        std::vector<clip_vertex> clipped_vertices;
+        clip_vertex fetch_vertex(uint32_t index) const;
+        const Vec2f &screen_pos(uint32_t index) const
+        {
+            size_t count = transformed_screen_pos.size();
+            return index < count ? transformed_screen_pos[index] : clipped_vertices[index - count].screen_pos;
+        }
+
+        // 渲染目标按当前模式分配：开启某个模式时才创建它需要的缓冲区，关闭时连同容量一起释放
+        // 深度缓冲只在面渲染且不开 msaa 时使用，子采样缓冲只在面渲染且开 msaa 时使用
+        void update_attachments();
 
         std::vector<float> depth_buf;
         std::vector<Vec3f> back_buf = {}; // 渲染用
 
         bool anti_Aliasing = false;
-        // ssaa抗锯齿用
-        const int samples = 2;
-        std::vector<float> super_depth_buf;
-        std::vector<Vec3f> super_back_buf = {};
+        // msaa抗锯齿用：每个子采样点单独保存深度和颜色，但每个像素每个三角形只着色一次
+        int sample_count = 4;
+        std::array<Vec2i, 8> sample_offsets; // 子采样点相对像素中心的偏移（亚像素）
+        int sample_extent;                   // 子采样点偏离像素中心的最大距离（亚像素）
+        std::vector<float> sample_depth_buf;
+        std::vector<Vec3f> sample_color_buf = {};
+        void resolve_samples(int x0, int y0, int x1, int y1);
+        // Hi-Z：每个 8x8 像素块保存当前深度缓冲（或其全部子采样）的保守最小/最大深度
+        static constexpr int hiz_tile_size = 8;
+        int hiz_width, hiz_height;
+        std::vector<float> hiz_min; // 块内最远的深度：三角形最近处都比它远则整块不可见
+        std::vector<float> hiz_max; // 块内最近的深度：三角形最远处都比它近则整块无需逐像素深度测试
+        std::atomic<size_t> hiz_rejected_tiles = 0;
+
         int get_index(int x, int y) const
         {
             return (height - y - 1) * width + x;
@@ -0,0 +1,513 @@
+﻿#pragma once
+#include <bit>
+#include "rasterizer.h"
+
+// 编译期特化的渲染管线：顶点处理与光栅化循环以着色器类型为模板参数，
+// 着色器调用在实例化时确定并内联展开，不再经过 std::function 的间接调用。
+// 这里只有模板定义，由定义着色器的源文件（Shader.cpp）包含并显式实例化
+
+// x64 下 SSE2 总是可用；其他平台退化为逐像素的标量实现
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define RST_USE_SSE
+#endif
+
+// 顶点处理：按顺序扫描位置、法线和切线流，每个唯一顶点做一次顶点着色，
+// 结果按属性写入各自连续的缓冲，并顺带完成近平面之后顶点的透视除法和屏幕映射
+// 实例化绘制时当前批的每个实例各做一遍，实例 k 的结果写在前 k 个实例之后，网格属性流被各个实例重复读取
+template <class Shader>
+void rst::rasterizer::process_vertices(const Mesh &mesh)
+{
+    const Shader shader{};
+    const size_t count = mesh.vertex_count();
+    const size_t total = count * instance_payloads.size();
+    current_mesh = &mesh;
+    transformed_clip_pos.resize(total);
+    transformed_view_pos.resize(total);
+    transformed_normal.resize(total);
+    transformed_tangent.resize(total);
+    transformed_screen_pos.resize(total);
+    clipped_vertices.clear();
+    // 没有生成切线的网格用任意方向代替，只有法线贴图着色器会用到
+    const Vec4f *tangents = mesh.tangents.size() == count ? mesh.tangents.data() : nullptr;
+
+    // 单线程时粒度取整个区间，直接在当前线程完成
+    jobs.parallel_for(0, total, multithreading ? setup_grain * 4 : total, [&](size_t begin, size_t end)
+    {
+        // 区间可能跨过实例的边界：j 为实例内的顶点下标，走到网格末尾时换到下一个实例
+        size_t instance = begin / count, j = begin - instance * count;
+        for (size_t i = begin; i < end; ++i, ++j)
+        {
+            if (j == count)
+            {
+                j = 0;
+                ++instance;
+            }
+            auto out = shader(instance_payloads[instance], mesh.positions[j], mesh.normals[j], tangents ? tangents[j] : Vec4f{1.f, 0.f, 0.f, 1.f});
+            transformed_clip_pos[i] = out.clip_pos;
+            transformed_view_pos[i] = out.view_pos;
+            transformed_normal[i] = out.normal;
+            transformed_tangent[i] = out.tangent;
+
+            // 近平面之前的顶点只会出现在需要裁剪的三角形中，不需要屏幕坐标
+            if (out.clip_pos.w() < clip_near)
+                continue;
+
+            // 透视除法，并将标准化设备坐标（NDC）坐标转换到屏幕空间坐标
+            Vec4f v = out.clip_pos;
+            v /= v.w();
+            transformed_screen_pos[i] = {(v.x + 1.0f) * 0.5f * width, (v.y + 1.0f) * 0.5f * height};
+        }
+    });
+}
+
+// 光栅化已经完成 setup 的屏幕空间三角形，只处理 [clip_min, clip_max) 范围内的像素
+// 每行先由边方程解析出可能被覆盖的像素区间，细长三角形不再扫描整个包围盒；
+// 区间内每次用 SIMD 测试 4 个像素，得到覆盖掩码后只对覆盖到的像素着色。
+// 通过深度测试的片元先攒成 8 个一批，再一起插值并交给着色器的 shade_batch。
+// 像素按 8x8 块处理：块内已有深度都比三角形最近处更近时整块跳过（Hi-Z），
+// 块被三角形完全覆盖且三角形最远处都比块内已有深度更近时省去逐像素深度测试
+template <class Shader>
+void rst::rasterizer::rasterize_setup_triangle(const triangle_setup &setup, int clip_min_x, int clip_min_y, int clip_max_x, int clip_max_y)
+{
+    int min_x = std::max(setup.min_x, clip_min_x);
+    int min_y = std::max(setup.min_y, clip_min_y);
+    int max_x = std::min(setup.max_x, clip_max_x);
+    int max_y = std::min(setup.max_y, clip_max_y);
+    if (min_x >= max_x || min_y >= max_y)
+        return;
+    prepare_tiles(min_x, min_y, max_x, max_y);
+
+    const auto &A = setup.A;
+    const auto &B = setup.B;
+    const auto &C = setup.C;
+    // 填充规则的偏置，插值前加回去得到真实的边方程值
+    const int64_t bias[3] = {is_top_left_edge(A[0], B[0]) ? 0 : 1, is_top_left_edge(A[1], B[1]) ? 0 : 1, is_top_left_edge(A[2], B[2]) ? 0 : 1};
+    // 从顶点缓冲取出三个顶点的属性
+    const clip_vertex vertex[3] = {fetch_vertex(setup.vertex[0]), fetch_vertex(setup.vertex[1]), fetch_vertex(setup.vertex[2])};
+    const std::array<Vec3f, 3> view_pos = {vertex[0].view_pos, vertex[1].view_pos, vertex[2].view_pos}; // 顶点在视空间中的坐标（做透视矫正、插值要用）
+    const std::array<Vec3f, 3> color = {vertex[0].color, vertex[1].color, vertex[2].color};
+    const std::array<Vec3f, 3> normal = {vertex[0].normal, vertex[1].normal, vertex[2].normal};
+    const std::array<Vec2f, 3> tex_coords = {vertex[0].tex_coords, vertex[1].tex_coords, vertex[2].tex_coords};
+    const std::array<Vec3f, 3> tangent = {vertex[0].tangent.head<3>(), vertex[1].tangent.head<3>(), vertex[2].tangent.head<3>()};
+    const float bitangent_sign = vertex[0].tangent.w() < 0.f ? -1.f : 1.f;
+
+    auto interpolate = [](float alpha, float beta, float gamma, const auto &array)
+    { return (alpha * array[0] + beta * array[1] + gamma * array[2]); }; // 对三角形各项属性做插值
+
+    // 纹理坐标的屏幕空间导数（解析求出，代替 2x2 像素块做差分）：
+    // u = Σ(α_i u_i / z_i) / Σ(α_i / z_i)，重心坐标沿 x、y 每个像素的变化率 α_i' 在三角形内是常数，
+    // 求导得 du/dx = (Σ α_i' u_i / z_i - u Σ α_i' / z_i) * z，其中的三个求和每个三角形只算一次
+    struct uv_gradient
+    {
+        float w, u, v;
+    };
+    auto make_gradient = [&](const std::array<int32_t, 3> &coef)
+    {
+        uv_gradient g{0.f, 0.f, 0.f};
+        for (int i = 0; i < 3; ++i)
+        {
+            float d = static_cast<float>(coef[i]) * subpixel_one * setup.inv_area / view_pos[i].z;
+            g.w += d;
+            g.u += d * tex_coords[i].x;
+            g.v += d * tex_coords[i].y;
+        }
+        return g;
+    };
+    const uv_gradient grad_x = make_gradient(A), grad_y = make_gradient(B);
+
+    bool depth_test = true; // 当前块是否需要逐像素深度测试
+    const Shader shader{};  // 着色器类型在编译期确定，调用直接内联进光栅化循环
+
+    // 由着色点处的边方程值做透视校正插值，调用片元着色器
+    auto shade = [&](int64_t e0, int64_t e1, int64_t e2) -> Vec3f
+    {
+        // 计算像素点的重心坐标
+        float alpha = static_cast<float>(e0 + bias[0]) * setup.inv_area;
+        float beta = static_cast<float>(e1 + bias[1]) * setup.inv_area;
+        float gamma = static_cast<float>(e2 + bias[2]) * setup.inv_area;
+        float z_corrected = 1.0f / (alpha / view_pos[0].z + beta / view_pos[1].z + gamma / view_pos[2].z);
+
+        // 对重心坐标做透视校正
+        float a_corrected = alpha / view_pos[0].z * z_corrected;
+        float b_corrected = beta / view_pos[1].z * z_corrected;
+        float g_corrected = gamma / view_pos[2].z * z_corrected;
+
+        pixel_shader_payload pixel_payload;
+        pixel_payload.color = interpolate(a_corrected, b_corrected, g_corrected, color);
+        pixel_payload.normal = interpolate(a_corrected, b_corrected, g_corrected, normal).normalize(); // 确保法线是单位向量
+        pixel_payload.tex_coords = interpolate(a_corrected, b_corrected, g_corrected, tex_coords);
+        pixel_payload.view_pos = interpolate(a_corrected, b_corrected, g_corrected, view_pos);
+        const Vec2f &uv = pixel_payload.tex_coords;
+        pixel_payload.tex_dx = Vec2f{grad_x.u - uv.x * grad_x.w, grad_x.v - uv.y * grad_x.w} * z_corrected;
+        pixel_payload.tex_dy = Vec2f{grad_y.u - uv.x * grad_y.w, grad_y.v - uv.y * grad_y.w} * z_corrected;
+        pixel_payload.tangent = interpolate(a_corrected, b_corrected, g_corrected, tangent);
+        pixel_payload.bitangent_sign = bitangent_sign;
+
+        return shader(pixel_payload, uniforms);
+    };
+
+    // 边方程值处透视校正后的视空间深度
+    auto depth_at = [&](int64_t e0, int64_t e1, int64_t e2) -> float
+    {
+        float alpha = static_cast<float>(e0 + bias[0]) * setup.inv_area;
+        float beta = static_cast<float>(e1 + bias[1]) * setup.inv_area;
+        float gamma = static_cast<float>(e2 + bias[2]) * setup.inv_area;
+        return 1.0f / (alpha / view_pos[0].z + beta / view_pos[1].z + gamma / view_pos[2].z);
+    };
+
+    // 对单个覆盖到的像素做深度测试，通过时更新深度，e0/e1/e2 为像素中心的边方程值
+    auto depth_pass = [&](int64_t e0, int64_t e1, int64_t e2, int ind) -> bool
+    {
+        float z_interpolated = depth_at(e0, e1, e2);
+        if (depth_test && z_interpolated < depth_buf[ind])
+            return false;
+        depth_buf[ind] = z_interpolated; // 更新z-buffer
+        return true;
+    };
+
+    // 写入着色结果：covered 为 0 时 ind 是像素下标，否则 ind 是 msaa 子采样的起始下标，covered 为通过测试的子采样
+    auto write_color = [&](int ind, unsigned covered, const Vec3f &pixel_color)
+    {
+        if (covered == 0)
+        {
+            back_buf[ind] = pixel_color / 255.f; // 分块已经准备好，且像素一定在屏幕内
+            return;
+        }
+        for (; covered != 0; covered &= covered - 1)
+            sample_color_buf[ind + std::countr_zero(covered)] = pixel_color;
+    };
+
+    // 等待批量着色的片元
+    struct pending_fragment
+    {
+        int ind;
+        unsigned covered;
+        int64_t e[3]; // 着色点的边方程值
+    };
+    std::array<pending_fragment, fragment_lanes> pending;
+    int pending_count = 0;
+    fragment_batch batch;
+
+    // 对攒下的片元逐通道做透视校正插值，再一次调用着色器
+    auto flush = [&]()
+    {
+        if constexpr (batch_shader<Shader>)
+        {
+            if (pending_count == 0)
+                return;
+            for (int i = pending_count; i < fragment_lanes; ++i)
+                pending[i] = pending[pending_count - 1];
+
+            for (int i = 0; i < fragment_lanes; ++i)
+            {
+                float alpha = static_cast<float>(pending[i].e[0] + bias[0]) * setup.inv_area;
+                float beta = static_cast<float>(pending[i].e[1] + bias[1]) * setup.inv_area;
+                float gamma = static_cast<float>(pending[i].e[2] + bias[2]) * setup.inv_area;
+                float z_corrected = 1.0f / (alpha / view_pos[0].z + beta / view_pos[1].z + gamma / view_pos[2].z);
+                float a = alpha / view_pos[0].z * z_corrected;
+                float b = beta / view_pos[1].z * z_corrected;
+                float g = gamma / view_pos[2].z * z_corrected;
+
+                batch.view_pos.x[i] = a * view_pos[0].x + b * view_pos[1].x + g * view_pos[2].x;
+                batch.view_pos.y[i] = a * view_pos[0].y + b * view_pos[1].y + g * view_pos[2].y;
+                batch.view_pos.z[i] = a * view_pos[0].z + b * view_pos[1].z + g * view_pos[2].z;
+                batch.color.x[i] = a * color[0].x + b * color[1].x + g * color[2].x;
+                batch.color.y[i] = a * color[0].y + b * color[1].y + g * color[2].y;
+                batch.color.z[i] = a * color[0].z + b * color[1].z + g * color[2].z;
+                batch.u[i] = a * tex_coords[0].x + b * tex_coords[1].x + g * tex_coords[2].x;
+                batch.v[i] = a * tex_coords[0].y + b * tex_coords[1].y + g * tex_coords[2].y;
+                batch.du_dx[i] = (grad_x.u - batch.u[i] * grad_x.w) * z_corrected;
+                batch.dv_dx[i] = (grad_x.v - batch.v[i] * grad_x.w) * z_corrected;
+                batch.du_dy[i] = (grad_y.u - batch.u[i] * grad_y.w) * z_corrected;
+                batch.dv_dy[i] = (grad_y.v - batch.v[i] * grad_y.w) * z_corrected;
+
+                float nx = a * normal[0].x + b * normal[1].x + g * normal[2].x;
+                float ny = a * normal[0].y + b * normal[1].y + g * normal[2].y;
+                float nz = a * normal[0].z + b * normal[1].z + g * normal[2].z;
+                float n = std::sqrt(nx * nx + ny * ny + nz * nz);
+                float inv_n = n == 0.f ? 1.f : 1.f / n; // 确保法线是单位向量
+                batch.normal.x[i] = nx * inv_n;
+                batch.normal.y[i] = ny * inv_n;
+                batch.normal.z[i] = nz * inv_n;
+                batch.tangent.x[i] = a * tangent[0].x + b * tangent[1].x + g * tangent[2].x;
+                batch.tangent.y[i] = a * tangent[0].y + b * tangent[1].y + g * tangent[2].y;
+                batch.tangent.z[i] = a * tangent[0].z + b * tangent[1].z + g * tangent[2].z;
+            }
+            batch.count = pending_count;
+            batch.bitangent_sign = bitangent_sign;
+
+            shader.shade_batch(batch, uniforms);
+            for (int i = 0; i < pending_count; ++i)
+                write_color(pending[i].ind, pending[i].covered, Vec3f{batch.result.x[i], batch.result.y[i], batch.result.z[i]});
+            pending_count = 0;
+        }
+    };
+
+    // 输出一个通过测试的片元：支持批量着色的着色器先攒起来，否则立即着色
+    auto emit = [&](int ind, unsigned covered, int64_t e0, int64_t e1, int64_t e2)
+    {
+        if constexpr (batch_shader<Shader>)
+        {
+            pending[pending_count++] = {ind, covered, {e0, e1, e2}};
+            if (pending_count == fragment_lanes)
+                flush();
+        }
+        else
+        {
+            write_color(ind, covered, shade(e0, e1, e2));
+        }
+    };
+
+    // 像素 (x, y) 的中心加上亚像素偏移 (sx, sy) 处相对原点的定点坐标
+    auto fixed_x = [&](int x, int sx = 0) { return (static_cast<int64_t>(x - setup.ox) << subpixel_bits) + subpixel_half + sx; };
+    auto fixed_y = [&](int y, int sy = 0) { return (static_cast<int64_t>(y - setup.oy) << subpixel_bits) + subpixel_half + sy; };
+
+    // 求出 [y_lo, y_hi] 高度上的采样点可能覆盖的像素区间 [span_begin, span_end)，左右各多留一个像素保证保守
+    // y_lo、y_hi 为相对像素左下角的像素坐标，这里只需要保守估计，换算成像素单位用 double 计算
+    auto row_span = [&](double y_lo, double y_hi, int &span_begin, int &span_end)
+    {
+        double lo = min_x, hi = max_x;
+        for (int i = 0; i < 3; ++i)
+        {
+            // E = A * 256 * (x - ox) + B * 256 * (y - oy) + C，取这一行中最靠近边内侧的采样高度
+            double a = static_cast<double>(A[i]) * subpixel_one;
+            double b = static_cast<double>(B[i]) * subpixel_one;
+            double row_e = std::max(b * (y_lo - setup.oy), b * (y_hi - setup.oy)) + static_cast<double>(C[i]);
+            if (a > 0)
+                lo = std::max(lo, setup.ox - row_e / a - 1.5); // 像素中心 x + 0.5 >= ox - row_e / a
+            else if (a < 0)
+                hi = std::min(hi, setup.ox - row_e / a + 1.5); // 像素中心 x + 0.5 <= ox - row_e / a
+            else if (row_e < 0)
+                hi = lo; // 水平边且整行都在边的外侧
+        }
+        span_begin = static_cast<int>(std::floor(std::clamp(lo, static_cast<double>(min_x), static_cast<double>(max_x))));
+        span_end = static_cast<int>(std::ceil(std::clamp(hi, static_cast<double>(min_x), static_cast<double>(max_x))));
+    };
+
+    // 边方程值：每向右一个像素的增量
+    const int64_t step[3] = {static_cast<int64_t>(A[0]) << subpixel_bits, static_cast<int64_t>(A[1]) << subpixel_bits, static_cast<int64_t>(A[2]) << subpixel_bits};
+
+    // 光栅化第 y 行的 [x_begin, x_end)，返回写入的像素数
+    auto raster_row = [&](int y, int x_begin, int x_end) -> int
+    {
+        int written = 0;
+        const int64_t px = fixed_x(x_begin), py = fixed_y(y);
+        int64_t row_e[3]; // x_begin 处像素中心的边方程值
+        for (int i = 0; i < 3; ++i)
+            row_e[i] = A[i] * px + B[i] * py + C[i];
+        alignas(16) int64_t e[3][4];
+#ifdef RST_USE_SSE
+        // 64 位整数，每个寄存器放两个像素，lo 为第 0、1 个像素，hi 为第 2、3 个像素
+        __m128i lo[3], hi[3], step4[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            lo[i] = _mm_set_epi64x(row_e[i] + step[i], row_e[i]);
+            hi[i] = _mm_set_epi64x(row_e[i] + 3 * step[i], row_e[i] + 2 * step[i]);
+            step4[i] = _mm_set1_epi64x(4 * step[i]);
+        }
+#else
+        int64_t cur[3] = {row_e[0], row_e[1], row_e[2]};
+#endif
+        for (int x = x_begin; x < x_end; x += 4)
+        {
+            int mask;
+#ifdef RST_USE_SSE
+            // 三条边的值按位或后符号位为 0，即三个边方程值都 >= 0 的像素被覆盖
+            __m128i outside_lo = _mm_or_si128(_mm_or_si128(lo[0], lo[1]), lo[2]);
+            __m128i outside_hi = _mm_or_si128(_mm_or_si128(hi[0], hi[1]), hi[2]);
+            mask = ~(_mm_movemask_pd(_mm_castsi128_pd(outside_lo)) | (_mm_movemask_pd(_mm_castsi128_pd(outside_hi)) << 2)) & 0xF;
+            if (mask != 0)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    _mm_store_si128(reinterpret_cast<__m128i *>(e[i]), lo[i]);
+                    _mm_store_si128(reinterpret_cast<__m128i *>(e[i] + 2), hi[i]);
+                }
+            }
+            for (int i = 0; i < 3; ++i)
+            {
+                lo[i] = _mm_add_epi64(lo[i], step4[i]);
+                hi[i] = _mm_add_epi64(hi[i], step4[i]);
+            }
+            if (mask == 0)
+                continue;
+#else
+            mask = 0;
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                for (int i = 0; i < 3; ++i)
+                    e[i][lane] = cur[i] + lane * step[i];
+                if ((e[0][lane] | e[1][lane] | e[2][lane]) >= 0)
+                    mask |= 1 << lane;
+            }
+            for (int i = 0; i < 3; ++i)
+                cur[i] += 4 * step[i];
+#endif
+            // 去掉超出区间的像素
+            int valid = x_end - x;
+            if (valid < 4)
+                mask &= (1 << valid) - 1;
+
+            for (; mask != 0; mask &= mask - 1)
+            {
+                int lane = std::countr_zero(static_cast<unsigned>(mask));
+                int ind = get_index(x + lane, y);
+                if (!depth_pass(e[0][lane], e[1][lane], e[2][lane], ind))
+                    continue;
+                emit(ind, 0, e[0][lane], e[1][lane], e[2][lane]);
+                ++written;
+            }
+        }
+        return written;
+    };
+
+    // 多重采样抗锯齿：每个子采样点各自做覆盖与深度测试，像素只着色一次，
+    // 结果写入所有通过测试的子采样点，最后由 resolve_samples 求平均。返回着色的像素数
+    std::array<std::array<int64_t, 3>, 8> sample_delta; // 子采样点相对像素中心的边方程增量
+    if (anti_Aliasing)
+    {
+        for (int s = 0; s < sample_count; ++s)
+            for (int i = 0; i < 3; ++i)
+                sample_delta[s][i] = static_cast<int64_t>(A[i]) * sample_offsets[s].x + static_cast<int64_t>(B[i]) * sample_offsets[s].y;
+    }
+    auto raster_row_msaa = [&](int y, int x_begin, int x_end) -> int
+    {
+        int written = 0;
+        const int64_t px = fixed_x(x_begin), py = fixed_y(y);
+        int64_t center[3]; // 当前像素中心的边方程值
+        for (int i = 0; i < 3; ++i)
+            center[i] = A[i] * px + B[i] * py + C[i];
+        for (int x = x_begin; x < x_end; ++x, center[0] += step[0], center[1] += step[1], center[2] += step[2])
+        {
+            int base = get_index(x, y) * sample_count;
+
+            unsigned covered = 0;
+            int64_t first[3]; // 第一个被覆盖的子采样点，像素中心不在三角形内时在这里着色
+            for (int s = 0; s < sample_count; ++s)
+            {
+                int64_t e0 = center[0] + sample_delta[s][0];
+                int64_t e1 = center[1] + sample_delta[s][1];
+                int64_t e2 = center[2] + sample_delta[s][2];
+                if ((e0 | e1 | e2) < 0)
+                    continue;
+                float z = depth_at(e0, e1, e2);
+                if (depth_test && z < sample_depth_buf[base + s])
+                    continue;
+                sample_depth_buf[base + s] = z;
+                if (covered == 0)
+                {
+                    first[0] = e0;
+                    first[1] = e1;
+                    first[2] = e2;
+                }
+                covered |= 1u << s;
+            }
+            if (covered == 0)
+                continue;
+
+            const int64_t *e = (center[0] | center[1] | center[2]) >= 0 ? center : first;
+            emit(base, covered, e[0], e[1], e[2]);
+            ++written;
+        }
+        return written;
+    };
+
+    // 采样点偏离像素中心的最大距离，用于判断块是否被三角形完全覆盖
+    const int extent = anti_Aliasing ? sample_extent : 0;
+    const double sample_lo = 0.5 - static_cast<double>(extent) / subpixel_one;
+    const double sample_hi = 0.5 + static_cast<double>(extent) / subpixel_one;
+    auto inside_all_edges = [&](int x, int y, int sx, int sy)
+    {
+        int64_t px = fixed_x(x, sx), py = fixed_y(y, sy);
+        for (int i = 0; i < 3; ++i)
+            if (A[i] * px + B[i] * py + C[i] < 0)
+                return false;
+        return true;
+    };
+
+    // 重新统计块内深度范围
+    const int depth_per_pixel = anti_Aliasing ? sample_count : 1;
+    auto update_hiz = [&](int block, int x0, int y0, int x1, int y1)
+    {
+        const auto &depth = anti_Aliasing ? sample_depth_buf : depth_buf;
+        float z_lo = std::numeric_limits<float>::infinity();
+        float z_hi = -std::numeric_limits<float>::infinity();
+        for (int y = y0; y < y1; ++y)
+        {
+            int begin = get_index(x0, y) * depth_per_pixel;
+            int end = get_index(x1 - 1, y) * depth_per_pixel + depth_per_pixel;
+            for (int i = begin; i < end; ++i)
+            {
+                z_lo = std::min(z_lo, depth[i]);
+                z_hi = std::max(z_hi, depth[i]);
+            }
+        }
+        hiz_min[block] = z_lo;
+        hiz_max[block] = z_hi;
+    };
+
+    size_t rejected = 0;
+    int span_begin[hiz_tile_size], span_end[hiz_tile_size];
+    for (int by = min_y / hiz_tile_size; by <= (max_y - 1) / hiz_tile_size; ++by)
+    {
+        int y0 = std::max(by * hiz_tile_size, min_y);
+        int y1 = std::min(by * hiz_tile_size + hiz_tile_size, max_y);
+
+        // 先求出这一排块中每一行的覆盖区间
+        int row_min = max_x, row_max = min_x;
+        for (int y = y0; y < y1; ++y)
+        {
+            auto &b = span_begin[y - y0];
+            auto &e = span_end[y - y0];
+            row_span(y + sample_lo, y + sample_hi, b, e);
+            if (b < e)
+            {
+                row_min = std::min(row_min, b);
+                row_max = std::max(row_max, e);
+            }
+        }
+        if (row_min >= row_max)
+            continue;
+
+        for (int bx = row_min / hiz_tile_size; bx <= (row_max - 1) / hiz_tile_size; ++bx)
+        {
+            int block = by * hiz_width + bx;
+            int x0 = std::max(bx * hiz_tile_size, min_x);
+            int x1 = std::min(bx * hiz_tile_size + hiz_tile_size, max_x);
+
+            // 三角形最近处都比块内最远的已有深度还远：整块被遮挡
+            if (setup.z_max < hiz_min[block])
+            {
+                ++rejected;
+                continue;
+            }
+
+            // 完整的块被三角形完全覆盖，且三角形最远处比块内最近的已有深度还近：整块必然通过深度测试
+            int full_x0 = bx * hiz_tile_size, full_y0 = by * hiz_tile_size;
+            int full_x1 = std::min(full_x0 + hiz_tile_size, width), full_y1 = std::min(full_y0 + hiz_tile_size, height);
+            depth_test = !(x0 == full_x0 && y0 == full_y0 && x1 == full_x1 && y1 == full_y1 &&
+                           setup.z_min > hiz_max[block] &&
+                           inside_all_edges(x0, y0, -extent, -extent) && inside_all_edges(x1 - 1, y0, extent, -extent) &&
+                           inside_all_edges(x0, y1 - 1, -extent, extent) && inside_all_edges(x1 - 1, y1 - 1, extent, extent));
+
+            int written = 0;
+            for (int y = y0; y < y1; ++y)
+            {
+                int xb = std::max(x0, span_begin[y - y0]);
+                int xe = std::min(x1, span_end[y - y0]);
+                if (xb >= xe)
+                    continue;
+                written += anti_Aliasing ? raster_row_msaa(y, xb, xe) : raster_row(y, xb, xe);
+            }
+
+            if (written > 0)
+                update_hiz(block, full_x0, full_y0, full_x1, full_y1);
+        }
+    }
+
+    flush();
+
+    if (rejected > 0)
+        hiz_rejected_tiles.fetch_add(rejected, std::memory_order_relaxed);
+}